@@ -28,48 +28,105 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Binary squares: an 8 byte BINARY_MAGIC, the size as a little-endian 64-bit
+// number, the bytes per cell (4 or 8) and 4 reserved zero bytes as 32-bit
+// numbers, then the size * size cells row by row as little-endian numbers
+#define BINARY_MAGIC "MAGICSQ1"
+#define BINARY_HEADER 24
+
+// Output is formatted and written in blocks of about this many bytes
+#define WRITE_BUFFER ( 1 << 20 )
 
 // Structure representing Square
 // size: dimension(number of rows/columns) of the square
-// array: 2D array of integers
+// array: size * size integers in one block, row by row; the cell at row r
+//        and column c is *( array + r * size + c )
 typedef struct _Square {
-	int size;
-	int **array;
+	size_t size;
+	int *array;
 } Square;
 
-int get_square_size();
-Square * generate_magic(int size);
-void write_to_file(Square * square, char *filename);
+size_t get_square_size();
+Square generate_magic(size_t size);
+Square generate_magic_parallel(size_t size, int threads);
+void write_to_file(Square * square, char *filename, int binary);
 
 int main(int argc, char *argv[])
 {       
+	// Options: -t <threads> for the closed form generator (default one per
+	// CPU), -w for the sequential Siamese walk, -c to check one against the
+	// other, -b to write the binary format
+	long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+	int threads = cpus > 0 ? cpus : 1;
+	int walk = 0;
+	int compare = 0;
+	int binary = 0;
+	int c;
+	while ( ( c = getopt( argc, argv, "t:wcb" ) ) != -1 ) {
+		switch ( c ) {
+		case 't':
+			threads = atoi( optarg );
+			break;
+		case 'w':
+			walk = 1;
+			break;
+		case 'c':
+			compare = 1;
+			break;
+		case 'b':
+			binary = 1;
+			break;
+		default:
+			printf( "Usage: %s [-t <threads>] [-w] [-c] [-b] <output file>\n", argv[0] );
+			exit( 1 );
+		}
+	}
+	if ( threads < 1 ) {
+		printf( "%s\n", "Threads must be positive" );
+		exit( 1 );
+	}
+
 	// Check input arguments to get filename
-	char *fileName = argv[1];
+	char *fileName = argv[optind];
 
-	if ( argv[1] == NULL ) {
+	if ( fileName == NULL ) {
 		printf( "%s\n", "Please enter output file" );
 		exit( 1 );
 	}
 
-	if ( argc > 2 ) {
+	if ( argc > optind + 1 ) {
 		printf( "%s\n", "Too many input variables" );
 		exit( 1 );
 	}
 
 	// Get size from user
-	int size = get_square_size();	
+	size_t size = get_square_size();	
 
 	// Generate the magic square
-	struct _Square *square = generate_magic( size );
+	Square square = walk ? generate_magic( size ) : generate_magic_parallel( size, threads );
+
+	// Check the closed form against the walk
+	if ( compare ) {
+		Square other = walk ? generate_magic_parallel( size, threads ) : generate_magic( size );
+		if ( memcmp( square.array, other.array, sizeof( int ) * size * size ) != 0 ) {
+			printf( "%s\n", "Closed form and Siamese walk differ" );
+			exit( 1 );
+		}
+		printf( "%s\n", "Closed form and Siamese walk match" );
+		free( other.array );
+	}
 
 	// Write the square to the output file
-	write_to_file( square, fileName );
+	write_to_file( &square, fileName, binary );
 	
-	// Free up dynamically allocated 2D array
-	int **squareArray = square->array;
-	for ( int i = 0; i < size; i++ ) {
-		free( *( squareArray + i ) );
-	}
+	// Free up the dynamically allocated square
+	free( square.array );
 
 	return 0;
 }
@@ -77,15 +134,15 @@ int main(int argc, char *argv[])
 /* get_square_size prompts the user for the magic square size
  * checks if it is an odd number >= 3 and returns the number
  */
-int get_square_size()
+size_t get_square_size()
 {
 	// Holds the square size
-	int size = 0;
+	long long size = 0;
 
 	// Prompts user to enter magic square size 
 	printf( "%s\n ", "Enter size of magic square, must be odd"  );
 	// Stores user input in size 
-	scanf( "%d", &size );
+	scanf( "%lld", &size );
 	// Check if scanf returned a negative number meaning it failed
 	if ( size <= 0 ) {
 		printf( "%s\n", "Failed to read input" );
@@ -96,8 +153,17 @@ int get_square_size()
 	while ( size < 3 || size % 2 == 0 ) {
 		printf("%s\n ", "Size must be an odd number >=3.");
 		size = 0;
-		scanf( "%d", &size );
+		if ( scanf( "%lld", &size ) != 1 ) {
+			printf( "%s\n", "Failed to read input" );
+			exit( 1 );
+		}
 	}	
+
+	// The largest number, size * size, must fit in an int
+	if ( size > INT_MAX / size ) {
+		printf( "%s\n", "Size is too large" );
+		exit( 1 );
+	}
 	
 	// Return square size
 	return size;
@@ -107,132 +173,321 @@ int get_square_size()
 /* generate_magic constructs a magic square of size n
  * using the Siamese algorithm and returns the Square struct
  */
-Square * generate_magic(int n)
+Square generate_magic(size_t n)
 {
-	// 2D array that holds the square as it is generated
-	int **squareArray;
-
-	// Initialize 2D array to size of n and check malloc return value
-	squareArray = malloc( sizeof( int ) * n );
+	// Square that holds the numbers as they are generated, all zero (empty)
+	int *squareArray = calloc( n * n, sizeof( int ) );
 	if ( squareArray == NULL ) {
 		printf( "%s\n", "Cannot allocate memory" );
 		exit( 1 );
 	}
-	for ( int i = 0; i < n; i++ ) {
-		*( squareArray + i ) = malloc( sizeof( int ) * n );
-	}
 	 
 	// Place a 1 at the center column of the topmost row
-	*( *( squareArray + 0 ) + ( ( ( n + 1 ) / 2 ) - 1 ) ) = 1;
+	size_t currRow = 0;
+	size_t currCol = ( ( n + 1 ) / 2 ) - 1;
+	*( squareArray + currCol ) = 1;
 
-	// Total number of squares to be filled not including the 1 spot
-	int total = ( n * n ) - 1;
+	// Populate the squareArray using siamese method: move one row up and one
+	// column to the right, wrapping around the edges, or one row down if that
+	// spot is already filled
+	for ( size_t currNumber = 2; currNumber <= n * n; currNumber++ ) {
+		size_t upRow = currRow == 0 ? n - 1 : currRow - 1;
+		size_t rightCol = currCol + 1 == n ? 0 : currCol + 1;
 
-	// currNumber will store next number to be filled in magic square
-	int currNumber = 2; 
+		if ( *( squareArray + upRow * n + rightCol ) != 0 ) {
+			currRow = currRow + 1;
+		}
+		else {
+			currRow = upRow;
+			currCol = rightCol;
+		}
+		*( squareArray + currRow * n + currCol ) = currNumber;
+	}
 
-	// Keeps track of current position in the square
-	int currRow = 0;
-	int currCol = ( ( n + 1 ) / 2 ) - 1 ;	  
+	// Return the square by value, the array stays on the heap
+	Square square = { n, squareArray };
+	return square;
+}
 
-	// Populate the squareArray using siamese method
-	for ( int i = 0; i < total; i++ ) {
+/* siamese_row fills row i of the size n square generate_magic builds.
+ * The walk puts n * ((i + j + n/2 + 1) mod n) + ((i + 2j + 1) mod n) + 1 at
+ * row i, column j, so a row is two counters stepping by 1 and 2 mod n.
+ */
+void siamese_row(int *row, size_t n, size_t i)
+{
+	size_t high = ( i + n / 2 + 1 ) % n;
+	size_t low = ( i + 1 ) % n;
+	for ( size_t j = 0; j < n; j++ ) {
+		*( row + j ) = high * n + low + 1;
+		high = high + 1 == n ? 0 : high + 1;
+		low = low + 2 >= n ? low + 2 - n : low + 2;
+	}
+}
 
-		// Check if one row up is outside the square and one column to the right is inside the square
-		if ( currRow - 1 < 0 && currCol + 1 < n ) {
-			if ( *( *( squareArray + ( n - 1 ) ) + ( currCol + 1 ) ) != 0 )  {
-				currRow = currRow + 1;
-				*( *( squareArray + currRow ) + currCol ) = currNumber;
-			}
-			else {
-				currRow = n - 1;
-				currCol = currCol + 1;
-				*( *( squareArray + currRow ) + currCol ) = currNumber; 
-			} 				
+// Structure describing one thread's share of a square: rows first .. last - 1
+typedef struct _RowBlock {
+	int *array;
+	size_t size;
+	size_t first;
+	size_t last;
+} RowBlock;
+
+/* fill_rows is a thread filling one block of rows */
+void * fill_rows(void *arg)
+{
+	RowBlock *block = arg;
+	for ( size_t i = block->first; i < block->last; i++ ) {
+		siamese_row( block->array + i * block->size, block->size, i );
+	}
+	return NULL;
+}
+
+/* generate_magic_parallel constructs the same square as generate_magic from
+ * the closed form of the Siamese walk, each thread filling an equal block of
+ * rows, and returns the Square struct
+ */
+Square generate_magic_parallel(size_t n, int threads)
+{
+	int *squareArray = malloc( sizeof( int ) * n * n );
+	if ( squareArray == NULL ) {
+		printf( "%s\n", "Cannot allocate memory" );
+		exit( 1 );
+	}
+	if ( threads < 1 ) {
+		threads = 1;
+	}
+	if ( ( size_t ) threads > n ) {
+		threads = n;
+	}
+
+	// Start a thread per block, this thread fills the first one
+	pthread_t *pool = malloc( sizeof( pthread_t ) * threads );
+	RowBlock *blocks = malloc( sizeof( RowBlock ) * threads );
+	if ( pool == NULL || blocks == NULL ) {
+		printf( "%s\n", "Cannot allocate memory" );
+		exit( 1 );
+	}
+	for ( int t = 1; t < threads; t++ ) {
+		RowBlock block = { squareArray, n, n * t / threads, n * ( t + 1 ) / threads };
+		*( blocks + t ) = block;
+		if ( pthread_create( pool + t, NULL, fill_rows, blocks + t ) != 0 ) {
+			printf( "%s\n", "Cannot create thread" );
+			exit( 1 );
 		}
-		// Check if one row up and one column to right are both inside the square 
-		else if ( currRow - 1 < n && currRow - 1 >= 0 && currCol + 1 < n ) {
-			if ( *( *( squareArray + ( currRow - 1 ) ) + ( currCol + 1 ) ) != 0 ) {
-				currRow = currRow + 1;
-				*( *( squareArray + currRow ) + currCol ) = currNumber;
-			}
-			else {
-				currRow = currRow - 1;
-				currCol = currCol + 1;
-				*( *( squareArray + currRow ) + currCol ) = currNumber;
-			}
+	}
+	RowBlock first = { squareArray, n, 0, n / threads };
+	fill_rows( &first );
+	for ( int t = 1; t < threads; t++ ) {
+		pthread_join( *( pool + t ), NULL );
+	}
+	free( blocks );
+	free( pool );
+
+	// Return the square by value, the array stays on the heap
+	Square square = { n, squareArray };
+	return square;
+}
+
+// Two digit strings "00" .. "99", for formatting numbers two digits at a time
+static const char digitPairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/* format_number writes value in decimal at out and returns the end */
+static inline char * format_number(char *out, unsigned int value)
+{
+	char digits[10];
+	char *pos = digits + sizeof( digits );
+	while ( value >= 100 ) {
+		pos -= 2;
+		memcpy( pos, digitPairs + 2 * ( value % 100 ), 2 );
+		value /= 100;
+	}
+	if ( value >= 10 ) {
+		pos -= 2;
+		memcpy( pos, digitPairs + 2 * value, 2 );
+	}
+	else {
+		*--pos = '0' + value;
+	}
+	size_t count = digits + sizeof( digits ) - pos;
+	memcpy( out, pos, count );
+	return out + count;
+}
+
+/* store_le writes the low bytes of value at out, least significant first */
+static inline void store_le(char *out, unsigned long long value, int bytes)
+{
+	for ( int b = 0; b < bytes; b++ ) {
+		*( out + b ) = value >> ( 8 * b );
+	}
+}
+
+/* format_text_row writes one row as verify_magic reads it, numbers
+ * separated by ", " and a newline, and returns the bytes written
+ */
+size_t format_text_row(char *out, const int *row, size_t size)
+{
+	char *pos = out;
+	for ( size_t b = 0; b < size; b++ ) {
+		pos = format_number( pos, *( row + b ) );
+		*pos++ = ',';
+		*pos++ = ' ';
+	}
+	*( pos - 2 ) = '\n';
+	return pos - 1 - out;
+}
+
+/* format_binary_row writes one row as 4 byte little-endian cells and
+ * returns the bytes written
+ */
+size_t format_binary_row(char *out, const int *row, size_t size)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy( out, row, size * 4 );
+#else
+	for ( size_t b = 0; b < size; b++ ) {
+		store_le( out + b * 4, *( row + b ), 4 );
+	}
+#endif
+	return size * 4;
+}
+
+/* write_all writes all length bytes of buffer to fd */
+void write_all(int fd, const char *buffer, size_t length)
+{
+	while ( length > 0 ) {
+		ssize_t done = write( fd, buffer, length );
+		if ( done < 0 ) {
+			printf( "%s\n", "Error writing file" );
+			exit( 1 );
 		}
-		// Check if one row up is inside the square and one column to the right is outside the square
-		else if ( currRow - 1 >= 0 && currCol + 1 >= n ) {
-			if ( *( *( squareArray + ( currRow - 1 ) ) + 0 ) != 0 ) {	
-				currRow = currRow + 1;
-				*( *( squareArray + currRow ) + currCol ) = currNumber;
-			}
-			else { 
-				currRow = currRow - 1;
-				currCol = 0;
-				*( *( squareArray + currRow ) + currCol ) = currNumber;
-			}
+		buffer = buffer + done;
+		length = length - done;
+	}
+}
+
+// Structure handing filled buffers from the formatting thread to the thread
+// writing them, so one block is formatted while the one before is written
+// buffers, lengths: the two blocks, used in turn
+// full: block i is formatted and waiting to be written
+// done: no more blocks will be filled
+typedef struct _Pipeline {
+	int fd;
+	char *buffers[2];
+	size_t lengths[2];
+	int full[2];
+	int done;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} Pipeline;
+
+/* write_blocks is the thread writing the pipeline's blocks in turn */
+void * write_blocks(void *arg)
+{
+	Pipeline *pipeline = arg;
+	for ( int i = 0; ; i = 1 - i ) {
+		pthread_mutex_lock( &pipeline->lock );
+		while ( !pipeline->full[i] && !pipeline->done ) {
+			pthread_cond_wait( &pipeline->changed, &pipeline->lock );
 		}
-		// Check is one row up and one column to right are both outside the square 
-		else if ( currRow - 1 < 0 && currCol + 1 >= n ) {
-			if ( *( *( squareArray + ( n - 1 ) ) + 0 ) != 0 ) {
-				currRow = currRow + 1; 
-				*( *( squareArray + currRow ) + currCol ) = currNumber;
-			}
-			else {
-				currRow = n - 1;
-				currCol = 0;
-				*( *( squareArray + currRow ) + currCol ) = currNumber;
-			}
+		if ( !pipeline->full[i] ) {
+			pthread_mutex_unlock( &pipeline->lock );
+			return NULL;
 		}
-  
-		// Increment the next number to be put into the square
-		currNumber = currNumber + 1;
- 	
-	}
+		pthread_mutex_unlock( &pipeline->lock );
 
-	// Create a square structure pointer to return
-	Square square = { n, squareArray };
-	struct _Square *returnPointer;
-	returnPointer = &square;
+		write_all( pipeline->fd, pipeline->buffers[i], pipeline->lengths[i] );
 
-	return returnPointer;
+		pthread_mutex_lock( &pipeline->lock );
+		pipeline->full[i] = 0;
+		pthread_cond_signal( &pipeline->changed );
+		pthread_mutex_unlock( &pipeline->lock );
+	}
 }
 
 /* write_to_file opens up a new file(or overwrites the existing file)
- * and writes out the square in the format expected by verify_magic.c
+ * and writes out the square in the format expected by verify_magic.c,
+ * as text or in the binary format.  Rows are formatted into blocks of at
+ * least WRITE_BUFFER bytes while a second thread writes the previous block
+ * with one big write.
  */
-void write_to_file(Square * square, char *filename)
+void write_to_file(Square * square, char *filename, int binary)
 {
-	int commaCount = 0;
-	int size = square->size;
-	int **squareArray = square->array;
+	size_t size = square->size;
+	int *squareArray = square->array;
 
 	// Create file
-	FILE *fp;
-	fp = fopen( filename, "w+" );
-	if ( fp == NULL ) {
+	int fd = open( filename, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( fd < 0 ) {
 		printf( "%s\n", "Cannot open output file" );
 		exit( 1 );
 	}
 
+	// Room for a block plus one row, at most 10 digits and ", " per number
+	size_t ( *format_row )( char *, const int *, size_t ) =
+		binary ? format_binary_row : format_text_row;
+	size_t capacity = WRITE_BUFFER + ( binary ? 4 : 12 ) * size + BINARY_HEADER;
+	Pipeline pipeline = { fd, { malloc( capacity ), malloc( capacity ) }, { 0, 0 }, { 0, 0 }, 0,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+	if ( pipeline.buffers[0] == NULL || pipeline.buffers[1] == NULL ) {
+		printf( "%s\n", "Cannot allocate memory" );
+		exit( 1 );
+	}
+	pthread_t writer;
+	if ( pthread_create( &writer, NULL, write_blocks, &pipeline ) != 0 ) {
+		printf( "%s\n", "Cannot create thread" );
+		exit( 1 );
+	}
+
 	// Write the square size and square to the file 
-	fprintf( fp, "%d\n", size );
-	for ( int a = 0; a < size; a++ ) {
-		for ( int b = 0; b < size; b++ ) {
-			if ( commaCount < size - 1 ) {
-				fprintf( fp, "%d%s", *( *( squareArray + a ) + b ), ", " ) ;
-				commaCount = commaCount + 1;
+	size_t a = 0;
+	for ( int i = 0; a < size; i = 1 - i ) {
+		// Wait for the block to be written
+		pthread_mutex_lock( &pipeline.lock );
+		while ( pipeline.full[i] ) {
+			pthread_cond_wait( &pipeline.changed, &pipeline.lock );
+		}
+		pthread_mutex_unlock( &pipeline.lock );
+
+		char *buffer = pipeline.buffers[i];
+		size_t length = 0;
+		if ( a == 0 ) {
+			if ( binary ) {
+				memcpy( buffer, BINARY_MAGIC, 8 );
+				store_le( buffer + 8, size, 8 );
+				store_le( buffer + 16, 4, 4 );
+				store_le( buffer + 20, 0, 4 );
+				length = BINARY_HEADER;
 			}
 			else {
-				fprintf( fp, "%d", *( *( squareArray + a ) + b ) );
-				commaCount = 0;
+				length = sprintf( buffer, "%zu\n", size );
 			}
 		}
-		fprintf( fp, "\n" );
+		for ( ; a < size && length < WRITE_BUFFER; a++ ) {
+			length = length + format_row( buffer + length, squareArray + a * size, size );
+		}
+
+		// Hand it to the writer
+		pthread_mutex_lock( &pipeline.lock );
+		pipeline.lengths[i] = length;
+		pipeline.full[i] = 1;
+		pthread_cond_signal( &pipeline.changed );
+		pthread_mutex_unlock( &pipeline.lock );
 	}
+
+	pthread_mutex_lock( &pipeline.lock );
+	pipeline.done = 1;
+	pthread_cond_signal( &pipeline.changed );
+	pthread_mutex_unlock( &pipeline.lock );
+	pthread_join( writer, NULL );
 	
 	// CLose the file 
-	fclose( fp );
+	if ( close( fd ) != 0 ) {
+		printf( "%s\n", "Error writing file" );
+		exit( 1 );
+	}
+	free( pipeline.buffers[0] );
+	free( pipeline.buffers[1] );
 }
@@ -29,174 +29,909 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Binary squares from generate_magic -b: an 8 byte BINARY_MAGIC, the size
+// as a little-endian 64-bit number, the bytes per cell (4 or 8) and 4
+// reserved bytes as 32-bit numbers, then the size * size cells row by row
+// as little-endian numbers
+#define BINARY_MAGIC "MAGICSQ1"
+#define BINARY_HEADER 24
 
 // Structure representing Square
 // size: dimension(number of rows/columns) of the square
-// array: 2D array of integers
+// array: size * size integers in one block, row by row; the cell at row r
+//        and column c is *( array + r * size + c )
+// mapped: 0 if array was malloc'd, or the length of the mapping of a binary
+//         file it points into
 typedef struct _Square {
-	int size;
-	int **array;
+	size_t size;
+	int *array;
+	size_t mapped;
 } Square;
 
-Square * construct_square(char *filename);
+Square construct_square(char *filename);
+void release_square(Square * square);
 int verify_magic(Square * square);
+int verify_magic_parallel(Square * square, int threads);
+int stream_verify(char *filename);
 
 int main(int argc, char *argv[])
 {	
+	// Options: -s checks the square while the file is read instead of
+	// loading it, -t <threads> checks a loaded square with that many threads
+	int stream = 0;
+	int threads = 1;
+	int c;
+	while ( ( c = getopt( argc, argv, "st:" ) ) != -1 ) {
+		switch ( c ) {
+		case 's':
+			stream = 1;
+			break;
+		case 't':
+			threads = atoi( optarg );
+			break;
+		default:
+			printf( "Usage: %s [-s] [-t <threads>] <input file>\n", argv[0] );
+			exit( 1 );
+		}
+	}
+	if ( threads < 1 ) {
+		printf( "%s\n", "Threads must be positive" );
+		exit( 1 );
+	}
+
 	// Check input arguments to get filename
-	char *fileName = argv[1];
-	if( argv[1] == NULL ) {
+	char *fileName = argv[optind];
+	if( fileName == NULL ) {
 		printf ("%s\n", "Cannot open input file" );
 		exit( 1 );
 	}
 
 	// Make sure user entered the right amount of input files
-	if ( argc > 2 || argc == 1 ) {
+	if ( argc > optind + 1 ) {
 		printf( "%s\n", "Please enter one input file" );
 		exit( 1 );
 	}
 
-	// Construct square
-	struct _Square *square = construct_square( fileName );
+	int magic;
+	if ( stream ) {
+		magic = stream_verify( fileName );
+	}
+	else {
+		// Construct square
+		Square square = construct_square( fileName );
+		magic = threads > 1 ? verify_magic_parallel( &square, threads ) : verify_magic( &square );
+		release_square( &square );
+	}
 
-	// Verify if it's a magic square and print true or false
-	if ( verify_magic( square ) == 1 ) {
+	// Print whether it's a magic square
+	if ( magic == 1 ) {
 		printf( "%s\n", "true" );
 	}
 	else {
 		printf( "%s\n", "false" );
 	}
 
-	int size = square->size;
-
-	for( int i = size - 1; i >= 0; i-- ) {
-		free( *( square->array + i ) );
-	}
-
 	return 0;
 }
 
-/* construct_square reads the input file to initialize a square struct
- * from the contents of the file and returns the square.
- * The format of the file is defined in the assignment specifications
+/* malformed reports a malformed input file and exits; line counts the
+ * size line as line 1
  */
-Square * construct_square(char *filename)
+void malformed(size_t line, char *reason)
 {
+	printf( "Malformed input on line %zu: %s\n", line, reason );
+	exit( 1 );
+}
 
-	// Open and read the file
-	FILE *file;
-	// Open file and make sure it is valid
-	file = fopen( filename, "r" );
-	if ( file == NULL ) {
+/* map_file maps the whole input file read-only and stores its length in
+ * *length; files that cannot be mapped (pipes) are read into memory
+ * instead.  Release it with unmap_file.
+ */
+const char * map_file(char *filename, size_t *length, int *mapped)
+{
+	int fd = open( filename, O_RDONLY );
+	if ( fd < 0 ) {
 		printf( "%s\n", "Cannot open input file" );
 		exit( 1 );
-	}	
+	}
 
-	// Buffer and integer for storing square size
-	int size = 0;	
-	char str[80];
+	struct stat st;
+	*mapped = 0;
+	if ( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0 ) {
+		void *data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( data != MAP_FAILED ) {
+			madvise( data, st.st_size, MADV_SEQUENTIAL );
+			close( fd );
+			*length = st.st_size;
+			*mapped = 1;
+			return data;
+		}
+	}
 
-	// Check fgets return value
-	if ( fgets( str, 5, file ) == NULL ) {
+	// Read what cannot be mapped into a growing buffer
+	size_t capacity = 1 << 20;
+	size_t used = 0;
+	char *data = malloc( capacity );
+	ssize_t got;
+	while ( data != NULL && ( got = read( fd, data + used, capacity - used ) ) > 0 ) {
+		used = used + got;
+		if ( used == capacity ) {
+			capacity = capacity * 2;
+			data = realloc( data, capacity );
+		}
+	}
+	if ( data == NULL || got < 0 ) {
 		printf( "%s\n", "Error reading file" );
 		exit( 1 );
 	}
-	// Store square size in the integer size
-	size = atoi( str );
-	
-	// Create token used for strtok
-	char *token;
+	close( fd );
+	*length = used;
+	return data;
+}
+
+/* unmap_file releases a file from map_file */
+void unmap_file(const char *data, size_t length, int mapped)
+{
+	if ( mapped ) {
+		munmap( ( void * ) data, length );
+	}
+	else {
+		free( ( void * ) data );
+	}
+}
+
+/* skip_blanks moves pos past spaces and tabs */
+static inline const char * skip_blanks(const char *pos, const char *end)
+{
+	while ( pos < end && ( *pos == ' ' || *pos == '\t' ) ) {
+		pos++;
+	}
+	return pos;
+}
+
+/* scan_number parses an optionally signed decimal integer that fits in an
+ * int at *pos, moving *pos past it.  Returns 1, or 0 if there is none or it
+ * is too large.
+ */
+static inline int scan_number(const char **pos, const char *end, long long *value)
+{
+	const char *p = *pos;
+	int negative = 0;
+	if ( p < end && *p == '-' ) {
+		negative = 1;
+		p++;
+	}
+	const char *digits = p;
+	long long v = 0;
+	while ( p < end && ( unsigned ) ( *p - '0' ) < 10 ) {
+		v = v * 10 + ( *p - '0' );
+		if ( v > INT_MAX ) {
+			return 0;
+		}
+		p++;
+	}
+	if ( p == digits ) {
+		return 0;
+	}
+	*value = negative ? -v : v;
+	*pos = p;
+	return 1;
+}
+
+/* end_line moves *pos past the end of the line (\n, \r\n or the end of
+ * the file) after optional blanks.  Returns 0 if anything else is there.
+ */
+static inline int end_line(const char **pos, const char *end)
+{
+	const char *p = skip_blanks( *pos, end );
+	if ( p < end && *p == '\r' ) {
+		p++;
+	}
+	if ( p < end && *p != '\n' ) {
+		return 0;
+	}
+	*pos = p < end ? p + 1 : p;
+	return 1;
+}
+
+/* parse_size reads the size line at *pos and returns the size */
+size_t parse_size(const char **pos, const char *end)
+{
+	long long size;
+	*pos = skip_blanks( *pos, end );
+	if ( !scan_number( pos, end, &size ) || !end_line( pos, end ) ) {
+		malformed( 1, "expected the square size" );
+	}
+	if ( size < 1 ) {
+		malformed( 1, "the square size must be positive" );
+	}
+	return size;
+}
+
+/* parse_row reads one line of size comma separated numbers at *pos into row
+ * and moves *pos to the next line; line is its line number for errors
+ */
+void parse_row(const char **pos, const char *end, int *row, size_t size, size_t line)
+{
+	const char *p = *pos;
+	if ( p == end ) {
+		malformed( line, "missing row" );
+	}
+	for ( size_t k = 0; k < size; k++ ) {
+		long long value;
+		p = skip_blanks( p, end );
+		if ( !scan_number( &p, end, &value ) ) {
+			malformed( line, p == end || *p == '\n' || *p == '\r' ? "too few numbers" :
+				*p == '-' || ( unsigned ) ( *p - '0' ) < 10 ? "number too large" :
+				"expected a number" );
+		}
+		*( row + k ) = value;
+		if ( k + 1 < size ) {
+			p = skip_blanks( p, end );
+			if ( p >= end || *p != ',' ) {
+				malformed( line, p < end && *p != '\n' && *p != '\r' ?
+					"expected a comma" : "too few numbers" );
+			}
+			p++;
+		}
+	}
+	if ( !end_line( &p, end ) ) {
+		malformed( line, *skip_blanks( p, end ) == ',' ? "too many numbers" : "unexpected character" );
+	}
+	*pos = p;
+}
 
-	// Create the 2D array using the size
-	int **squareArray;
-	squareArray = malloc( sizeof( int ) * size );
+/* malformed_binary reports a malformed binary input file and exits */
+void malformed_binary(char *reason)
+{
+	printf( "Malformed binary input: %s\n", reason );
+	exit( 1 );
+}
+
+/* load_le reads a little-endian number of the given bytes at in */
+static inline unsigned long long load_le(const char *in, int bytes)
+{
+	unsigned long long value = 0;
+	for ( int b = bytes - 1; b >= 0; b-- ) {
+		value = ( value << 8 ) | ( unsigned char ) *( in + b );
+	}
+	return value;
+}
+
+/* is_binary tells if the length bytes at data start like a binary square */
+int is_binary(const char *data, size_t length)
+{
+	return length >= 8 && memcmp( data, BINARY_MAGIC, 8 ) == 0;
+}
+
+/* parse_binary_header checks the header of a binary square, stores the
+ * bytes per cell in *cellBytes and returns the size
+ */
+size_t parse_binary_header(const char *header, size_t *cellBytes)
+{
+	unsigned long long size = load_le( header + 8, 8 );
+	*cellBytes = load_le( header + 16, 4 );
+	if ( *cellBytes != 4 && *cellBytes != 8 ) {
+		malformed_binary( "cells must be 4 or 8 bytes" );
+	}
+	if ( size < 1 ) {
+		malformed_binary( "the square size must be positive" );
+	}
+	if ( size > UINT32_MAX || size * size > ( SIZE_MAX - BINARY_HEADER ) / *cellBytes ) {
+		malformed_binary( "the square is too large" );
+	}
+	return size;
+}
+
+/* decode_row converts size little-endian cells at cells into ints in row;
+ * numbers too large for an int become 0, which is never magic
+ */
+void decode_row(int *row, const char *cells, size_t size, size_t cellBytes)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	// Numbers above INT_MAX read as negative ints, which are never magic
+	if ( cellBytes == 4 ) {
+		memcpy( row, cells, size * 4 );
+		return;
+	}
+#endif
+	for ( size_t k = 0; k < size; k++ ) {
+		unsigned long long value = load_le( cells + k * cellBytes, cellBytes );
+		*( row + k ) = value > INT_MAX ? 0 : value;
+	}
+}
+
+/* construct_binary_square makes a square of the length bytes of the binary
+ * file at data.  A mapped file of 4 byte cells on a little-endian machine is
+ * used in place, without reading it; otherwise the cells are converted into
+ * a new array and the file is released.
+ */
+Square construct_binary_square(const char *data, size_t length, int mapped)
+{
+	if ( length < BINARY_HEADER ) {
+		malformed_binary( "the header is cut short" );
+	}
+	size_t cellBytes;
+	size_t size = parse_binary_header( data, &cellBytes );
+	if ( length != BINARY_HEADER + size * size * cellBytes ) {
+		malformed_binary( "the file length does not match the square size" );
+	}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	// Numbers above INT_MAX read as negative ints, which are never magic
+	if ( mapped && cellBytes == 4 ) {
+		Square square = { size, ( int * ) ( data + BINARY_HEADER ), length };
+		return square;
+	}
+#endif
+
+	int *squareArray = malloc( sizeof( int ) * size * size );
 	if ( squareArray == NULL ) {
 		printf( "%s\n", "malloc is NULL" );
 		exit( 1 );
 	}
-	for ( int i = 0; i < size; i++ ) {
-		*( squareArray + i ) = malloc( sizeof( int ) * size );
+	for ( size_t i = 0; i < size; i++ ) {
+		decode_row( squareArray + i * size, data + BINARY_HEADER + i * size * cellBytes,
+			size, cellBytes );
 	}
+	unmap_file( data, length, mapped );
 
-	// Populate the 2D array
-	for ( int i = 0; i < size; i++ ) {
-		int k = 0;
-		fgets( str, 200, file );
-		str[ strcspn( str, "\n" ) ] = 0;
-		token = strtok( str, ", " );
-		while ( token != NULL ) {
-			*( *( squareArray + i ) + k ) = atoi( token );
-			token = strtok( NULL, ", " );
-			k = k + 1;
-		}
+	Square square = { size, squareArray, 0 };
+	return square;
+}
+
+/* construct_square reads the input file to initialize a square struct
+ * from the contents of the file and returns the square.
+ * The first line holds the size n, and each of the next n lines holds n
+ * comma separated numbers; blanks around numbers and blank lines at the end
+ * are allowed, anything else is rejected.  The file is mapped and parsed
+ * straight into the square's array.  Binary files from generate_magic -b
+ * are recognised by their header.
+ */
+Square construct_square(char *filename)
+{
+	// Map the whole file
+	size_t length;
+	int mapped;
+	const char *data = map_file( filename, &length, &mapped );
+	const char *pos = data;
+	const char *end = data + length;
+	if ( is_binary( data, length ) ) {
+		return construct_binary_square( data, length, mapped );
+	}
+
+	// Read the square size
+	size_t size = parse_size( &pos, end );
+	if ( size > SIZE_MAX / sizeof( int ) / size ) {
+		malformed( 1, "the square is too large" );
 	}
 
-	// Close file
-	fclose( file );
+	// Create the square's array using the size
+	int *squareArray;
+	squareArray = malloc( sizeof( int ) * size * size );
+	if ( squareArray == NULL ) {
+		printf( "%s\n", "malloc is NULL" );
+		exit( 1 );
+	}
+
+	// Populate the array
+	for ( size_t i = 0; i < size; i++ ) {
+		parse_row( &pos, end, squareArray + i * size, size, i + 2 );
+	}
+
+	// Only blank lines may follow the last row
+	while ( pos < end && ( *pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n' ) ) {
+		pos++;
+	}
+	if ( pos != end ) {
+		malformed( size + 2, "too many rows" );
+	}
+
+	// Release the file
+	unmap_file( data, length, mapped );
 	
-	// Initialize new square pointer and return it
-	Square square = { size, squareArray };
-	struct _Square *squarePointer;
-	squarePointer = &square;
+	// Return the square by value, the array stays on the heap
+	Square square = { size, squareArray, 0 };
+	return square;
+}
+
+/* release_square frees the square's array, or unmaps the file it is in */
+void release_square(Square * square)
+{
+	if ( square->mapped ) {
+		munmap( ( char * ) square->array - BINARY_HEADER, square->mapped );
+	}
+	else {
+		free( square->array );
+	}
+}
+
+/* add_columns_scalar adds one row of the square to the running column sums
+ */
+void add_columns_scalar(long long *colSums, const int *row, size_t size)
+{
+	for ( size_t k = 0; k < size; k++ ) {
+		*( colSums + k ) += *( row + k );
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* add_columns_avx2 adds one row to the column sums four columns at a time,
+ * widening the ints to 64 bits before adding
+ */
+__attribute__( ( target( "avx2" ) ) )
+void add_columns_avx2(long long *colSums, const int *row, size_t size)
+{
+	size_t k = 0;
+	for ( ; k + 4 <= size; k += 4 ) {
+		__m256i wide = _mm256_cvtepi32_epi64( _mm_loadu_si128( ( const __m128i * ) ( row + k ) ) );
+		__m256i sums = _mm256_loadu_si256( ( const __m256i * ) ( colSums + k ) );
+		_mm256_storeu_si256( ( __m256i * ) ( colSums + k ), _mm256_add_epi64( sums, wide ) );
+	}
+	add_columns_scalar( colSums + k, row + k, size - k );
+}
+#endif
+
+// Structure holding the running sums of a square being checked row by row
+// size, cells: dimension of the square and size^2
+// sum: what every row, column and diagonal must add up to
+// colSums: sum of each column so far
+// seen: one bit per value 1 .. size^2 that has been seen
+// ownsSeen: seen was allocated for this checker, not borrowed from another
+// atomicSeen: other threads set bits in seen too, so bits are set atomically
+// diagSum, antiDiagSum: sums of both diagonals so far
+typedef struct _Checker {
+	size_t size;
+	size_t cells;
+	long long sum;
+	long long *colSums;
+	unsigned long long *seen;
+	int ownsSeen;
+	int atomicSeen;
+	long long diagSum;
+	long long antiDiagSum;
+	void ( *add_columns )( long long *, const int *, size_t );
+} Checker;
 
-	return squarePointer;
+/* start_check sets up a checker for a square of the given size.  If
+ * shareWith is not NULL the checker checks other rows of the same square
+ * from another thread, setting bits in shareWith's seen values.
+ */
+void start_check(Checker *checker, size_t size, Checker *shareWith)
+{
+	checker->size = size;
+	checker->cells = size * size;
+	checker->sum = ( long long ) size * ( checker->cells + 1 ) / 2;
+	checker->diagSum = 0;
+	checker->antiDiagSum = 0;
+
+	// Pick the column adder this CPU can run, only x86 has the AVX2 one
+#if defined(__x86_64__) || defined(__i386__)
+	checker->add_columns =
+		__builtin_cpu_supports( "avx2" ) ? add_columns_avx2 : add_columns_scalar;
+#else
+	checker->add_columns = add_columns_scalar;
+#endif
+
+	checker->colSums = calloc( size, sizeof( long long ) );
+	checker->ownsSeen = shareWith == NULL;
+	checker->atomicSeen = shareWith != NULL;
+	if ( shareWith != NULL ) {
+		shareWith->atomicSeen = 1;
+		checker->seen = shareWith->seen;
+	}
+	else {
+		checker->seen = calloc( checker->cells / 64 + 1, sizeof( unsigned long long ) );
+	}
+	if ( checker->colSums == NULL || checker->seen == NULL ) {
+		printf( "%s\n", "Cannot allocate memory" );
+		exit( 1 );
+	}
+}
+
+/* check_row checks that row i holds new values in 1 .. size^2 that add up
+ * to the magic sum, and adds it to the column and diagonal sums
+ * 
+ * returns 1(true) or 0(false)
+ */
+int check_row(Checker *checker, const int *row, size_t i)
+{
+	size_t size = checker->size;
+	long long rowSum = 0;
+	for ( size_t k = 0; k < size; k++ ) {
+		long long value = *( row + k );
+		if ( value < 1 || ( size_t ) value > checker->cells ) {
+			return 0;
+		}
+		unsigned long long bit = 1ULL << ( value % 64 );
+		unsigned long long *word = checker->seen + value / 64;
+		unsigned long long old = *word;
+		if ( checker->atomicSeen ) {
+			// The old word tells if any thread set the bit first
+			old = __atomic_fetch_or( word, bit, __ATOMIC_RELAXED );
+		}
+		else {
+			*word = old | bit;
+		}
+		if ( old & bit ) {
+			return 0;
+		}
+		rowSum = rowSum + value;
+	}
+	if ( rowSum != checker->sum ) {
+		return 0;
+	}
+	checker->add_columns( checker->colSums, row, size );
+	checker->diagSum = checker->diagSum + *( row + i );
+	checker->antiDiagSum = checker->antiDiagSum + *( row + ( size - 1 - i ) );
+	return 1;
 }
 
-/* verify_magic verifies if the square is a magic square
+/* free_check frees a checker without finishing the check */
+void free_check(Checker *checker)
+{
+	if ( checker->ownsSeen ) {
+		free( checker->seen );
+	}
+	free( checker->colSums );
+}
+
+/* finish_check checks the columns and both diagonals once every row has
+ * passed check_row, and frees the checker
+ * 
+ * returns 1(true) or 0(false)
+ */
+int finish_check(Checker *checker)
+{
+	int magic = 1;
+	for ( size_t k = 0; k < checker->size && magic; k++ ) {
+		if ( *( checker->colSums + k ) != checker->sum ) {
+			magic = 0;
+		}
+	}
+	if ( checker->diagSum != checker->sum || checker->antiDiagSum != checker->sum ) {
+		magic = 0;
+	}
+	free_check( checker );
+	return magic;
+}
+
+/* merge_check adds the column and diagonal sums of part, which checked
+ * some other rows of the same square, into checker, and frees part
+ */
+void merge_check(Checker *checker, Checker *part)
+{
+	for ( size_t k = 0; k < checker->size; k++ ) {
+		*( checker->colSums + k ) += *( part->colSums + k );
+	}
+	checker->diagSum = checker->diagSum + part->diagSum;
+	checker->antiDiagSum = checker->antiDiagSum + part->antiDiagSum;
+	free_check( part );
+}
+
+/* verify_magic verifies if the square is a magic square: it holds each of
+ * 1 .. size^2 exactly once and every row, column and both diagonals add up
+ * to size * (size^2 + 1) / 2.  The square is read once, row by row, with
+ * 64-bit sums; each value is checked off in a bitset as it is read.
  * 
  * returns 1(true) or 0(false)
  */
 int verify_magic(Square * square)
 {
-	int sum = 0;
-	int tempSum = 0;
-	int **squareArray = square->array;
-	int size = square->size;	
+	Checker checker;
+	int magic = 1;
 
-	// Get sum of first col to compare to later
-	for ( int i = 0; i < size; i++ ) {
-		sum = sum + ( *( *( squareArray + i ) + 0 ) );
+	start_check( &checker, square->size, NULL );
+	for ( size_t i = 0; i < square->size && magic; i++ ) {
+		magic = check_row( &checker, square->array + i * square->size, i );
 	}
+	return finish_check( &checker ) && magic;
+}
+
+// Set by the first thread of verify_magic_parallel to find a row that is
+// not magic, so the others stop
+int mismatch;
 
-	// Check all rows sum to same number
-	for ( int i = 0; i < size; i++ ) {
-		for ( int k = 0; k < size; k++ ) {
-			tempSum = tempSum + *( *( squareArray + i ) + k );
+// Structure describing one thread's share of verify_magic_parallel: rows
+// first .. last - 1 of square, checked with its own checker
+typedef struct _RowBlock {
+	Square *square;
+	Checker checker;
+	size_t first;
+	size_t last;
+} RowBlock;
+
+/* check_rows is a thread checking one block of rows */
+void * check_rows(void *arg)
+{
+	RowBlock *block = arg;
+	size_t size = block->square->size;
+	for ( size_t i = block->first; i < block->last; i++ ) {
+		if ( __atomic_load_n( &mismatch, __ATOMIC_RELAXED ) ) {
+			break;
 		}
-		if ( tempSum != sum ) {
-			return 0;
+		if ( !check_row( &block->checker, block->square->array + i * size, i ) ) {
+			__atomic_store_n( &mismatch, 1, __ATOMIC_RELAXED );
+			break;
 		}
-		tempSum = 0;
 	}
+	return NULL;
+}
 
-	// Check all cols sum to same number
-	for ( int i = 0; i < size; i++ ) {
-		for ( int k = 0; k < size; k++ ) {
-			tempSum = tempSum + *( *( squareArray + k ) + i );
-		}
-		if ( tempSum != sum ) {
-			return 0;
+/* verify_magic_parallel is verify_magic with the rows split into equal
+ * blocks, one per thread.  Each thread keeps its own column and diagonal
+ * sums, which are added up once all are done; values are checked off in
+ * one bitset shared by all threads with atomic updates.  All threads stop
+ * as soon as one finds a row that is not magic, and nothing is added up.
+ * 
+ * returns 1(true) or 0(false)
+ */
+int verify_magic_parallel(Square * square, int threads)
+{
+	size_t size = square->size;
+	if ( ( size_t ) threads > size ) {
+		threads = size;
+	}
+	mismatch = 0;
+
+	RowBlock *blocks = malloc( sizeof( RowBlock ) * threads );
+	pthread_t *pool = malloc( sizeof( pthread_t ) * threads );
+	if ( blocks == NULL || pool == NULL ) {
+		printf( "%s\n", "Cannot allocate memory" );
+		exit( 1 );
+	}
+
+	// Start a thread per block, this thread checks the first one with the
+	// checker owning the bitset
+	RowBlock *first = blocks;
+	for ( int t = 0; t < threads; t++ ) {
+		RowBlock *block = blocks + t;
+		block->square = square;
+		block->first = size * t / threads;
+		block->last = size * ( t + 1 ) / threads;
+		start_check( &block->checker, size, t == 0 ? NULL : &first->checker );
+	}
+	for ( int t = 1; t < threads; t++ ) {
+		if ( pthread_create( pool + t, NULL, check_rows, blocks + t ) != 0 ) {
+			printf( "%s\n", "Cannot create thread" );
+			exit( 1 );
 		}
-		tempSum = 0;
+	}
+	check_rows( first );
+
+	for ( int t = 1; t < threads; t++ ) {
+		pthread_join( *( pool + t ), NULL );
 	}
 
-	// Check main diagonal
-	for ( int i = 0; i < size; i++ ) {
-		tempSum = tempSum + *( *( squareArray + i ) + i );
+	// Add up the other threads' sums, unless a row already failed
+	int magic = 0;
+	if ( mismatch ) {
+		for ( int t = 0; t < threads; t++ ) {
+			free_check( &( blocks + t )->checker );
+		}
+	}
+	else {
+		for ( int t = 1; t < threads; t++ ) {
+			merge_check( &first->checker, &( blocks + t )->checker );
+		}
+		magic = finish_check( &first->checker );
 	}
-	if ( tempSum != sum ) {
+
+	free( pool );
+	free( blocks );
+	return magic;
+}
+
+// Structure reading a file one line at a time through a buffer
+// buffer: bytes read so far that have not been handed out, from start to end
+// eof: set once read returns 0
+typedef struct _LineReader {
+	int fd;
+	char *buffer;
+	size_t capacity;
+	size_t start;
+	size_t end;
+	int eof;
+} LineReader;
+
+/* fill_reader moves the unread bytes to the front of the buffer, growing
+ * it if they fill it, and reads more after them.  Returns 0 at the end of
+ * the file.
+ */
+int fill_reader(LineReader *reader)
+{
+	if ( reader->eof ) {
 		return 0;
 	}
-	tempSum = 0;
+	size_t left = reader->end - reader->start;
+	memmove( reader->buffer, reader->buffer + reader->start, left );
+	reader->start = 0;
+	reader->end = left;
+	if ( reader->end == reader->capacity ) {
+		reader->capacity = reader->capacity * 2;
+		reader->buffer = realloc( reader->buffer, reader->capacity );
+		if ( reader->buffer == NULL ) {
+			printf( "%s\n", "Cannot allocate memory" );
+			exit( 1 );
+		}
+	}
 
-	// Check secondary diagonal
-	for ( int i = size - 1; i > -1; i-- ) {
-		tempSum = tempSum + *( *( squareArray + i ) + i );
+	ssize_t got = read( reader->fd, reader->buffer + reader->end,
+		reader->capacity - reader->end );
+	if ( got < 0 ) {
+		printf( "%s\n", "Error reading file" );
+		exit( 1 );
 	}
-	if ( tempSum != sum ) {
+	if ( got == 0 ) {
+		reader->eof = 1;
 		return 0;
-	}	
-
+	}
+	reader->end = reader->end + got;
 	return 1;
+}
+
+/* next_line returns the next line of the reader, with *lineEnd just past its
+ * newline, or NULL at the end of the file.  The line stays valid until the
+ * next call; the buffer grows to fit lines of any length.
+ */
+const char * next_line(LineReader *reader, const char **lineEnd)
+{
+	size_t scanned = 0;
+	for ( ;; ) {
+		char *pos = reader->buffer + reader->start;
+		size_t left = reader->end - reader->start;
+		char *newline = memchr( pos + scanned, '\n', left - scanned );
+		if ( newline != NULL || ( reader->eof && left > 0 ) ) {
+			*lineEnd = newline != NULL ? newline + 1 : pos + left;
+			reader->start = *lineEnd - reader->buffer;
+			return pos;
+		}
+		scanned = left;
+		if ( !fill_reader( reader ) && left == 0 ) {
+			return NULL;
+		}
+	}
+}
+
+/* next_bytes returns the next count bytes of the reader, or NULL if the
+ * file ends first.  They stay valid until the next call.
+ */
+const char * next_bytes(LineReader *reader, size_t count)
+{
+	while ( reader->end - reader->start < count ) {
+		if ( !fill_reader( reader ) ) {
+			return NULL;
+		}
+	}
+	const char *pos = reader->buffer + reader->start;
+	reader->start = reader->start + count;
+	return pos;
+}
+
+/* stream_verify_binary is stream_verify for a binary file, reading whole
+ * rows of cells instead of lines
+ * 
+ * returns 1(true) or 0(false)
+ */
+int stream_verify_binary(LineReader *reader)
+{
+	const char *header = next_bytes( reader, BINARY_HEADER );
+	if ( header == NULL ) {
+		malformed_binary( "the header is cut short" );
+	}
+	size_t cellBytes;
+	size_t size = parse_binary_header( header, &cellBytes );
+
+	int *row = malloc( sizeof( int ) * size );
+	if ( row == NULL ) {
+		printf( "%s\n", "malloc is NULL" );
+		exit( 1 );
+	}
+
+	Checker checker;
+	int magic = 1;
+	start_check( &checker, size, NULL );
+	for ( size_t i = 0; i < size && magic; i++ ) {
+		const char *cells = next_bytes( reader, size * cellBytes );
+		if ( cells == NULL ) {
+			malformed_binary( "the file length does not match the square size" );
+		}
+		decode_row( row, cells, size, cellBytes );
+		magic = check_row( &checker, row, i );
+	}
+	if ( magic && next_bytes( reader, 1 ) != NULL ) {
+		malformed_binary( "the file length does not match the square size" );
+	}
+	magic = finish_check( &checker ) && magic;
+
+	free( row );
+	return magic;
+}
+
+/* stream_verify verifies the square in the input file as it is read,
+ * without building it in memory: each row is parsed into one row buffer
+ * and checked, keeping only the column sums, diagonal sums and the bitset
+ * of seen values, so memory is O(size) plus size^2 bits.  It stops at the
+ * first row that fails; the rest of the file is not read.  Binary files
+ * are read a row of cells at a time.
+ * 
+ * returns 1(true) or 0(false)
+ */
+int stream_verify(char *filename)
+{
+	LineReader reader = { 0, NULL, 1 << 20, 0, 0, 0 };
+	reader.fd = open( filename, O_RDONLY );
+	reader.buffer = malloc( reader.capacity );
+	if ( reader.fd < 0 ) {
+		printf( "%s\n", "Cannot open input file" );
+		exit( 1 );
+	}
+	if ( reader.buffer == NULL ) {
+		printf( "%s\n", "Cannot allocate memory" );
+		exit( 1 );
+	}
+	posix_fadvise( reader.fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+	// Binary files are told apart by their first bytes
+	while ( reader.end < 8 && fill_reader( &reader ) ) {
+	}
+	if ( is_binary( reader.buffer, reader.end ) ) {
+		int magic = stream_verify_binary( &reader );
+		free( reader.buffer );
+		close( reader.fd );
+		return magic;
+	}
+
+	// Read the square size
+	const char *lineEnd;
+	const char *line = next_line( &reader, &lineEnd );
+	if ( line == NULL ) {
+		lineEnd = line = reader.buffer;
+	}
+	size_t size = parse_size( &line, lineEnd );
+
+	int *row = malloc( sizeof( int ) * size );
+	if ( row == NULL ) {
+		printf( "%s\n", "malloc is NULL" );
+		exit( 1 );
+	}
+
+	// Parse and check each row as it arrives
+	Checker checker;
+	int magic = 1;
+	start_check( &checker, size, NULL );
+	for ( size_t i = 0; i < size && magic; i++ ) {
+		line = next_line( &reader, &lineEnd );
+		if ( line == NULL ) {
+			lineEnd = line = reader.buffer;
+		}
+		parse_row( &line, lineEnd, row, size, i + 2 );
+		magic = check_row( &checker, row, i );
+	}
+
+	// Only blank lines may follow the last row
+	while ( magic && ( line = next_line( &reader, &lineEnd ) ) != NULL ) {
+		for ( ; line < lineEnd; line++ ) {
+			if ( *line != ' ' && *line != '\t' && *line != '\r' && *line != '\n' ) {
+				malformed( size + 2, "too many rows" );
+			}
+		}
+	}
+	magic = finish_check( &checker ) && magic;
 
+	free( row );
+	free( reader.buffer );
+	close( reader.fd );
+	return magic;
 }
@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////
+// Main File:        cachebench.c
+// This File:        bench.c
+// Other Files:      bench.h
+// Semester:         CS 354 Spring 2017
+//
+// Author:           Sean Kim
+// Email:            skim658@wisc.edu
+// CS Login:         seank
+//
+// Timing, allocation and hardware counter helpers shared by the Part 1
+// benchmarks.
+//
+////////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <x86intrin.h>
+
+#include "bench.h"
+
+const char *counter_names[NUM_COUNTERS] = { "cycles", "cache-misses", "dtlb-misses" };
+const char *page_kind_names[NUM_PAGE_KINDS] = { "base", "thp", "hugetlb" };
+
+/* nowNs - monotonic time in nanoseconds */
+double nowNs() {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* tscPerNs - time stamp counter ticks per nanosecond, measured once over
+ * 50ms.  Used as the clock rate for bytes/cycle when the cycle counter
+ * cannot be read.
+ */
+double tscPerNs() {
+	static double rate = 0;
+	if ( rate == 0 ) {
+		double start = nowNs();
+		unsigned long long tsc = __rdtsc();
+		while ( nowNs() - start < 50e6 ) {
+		}
+		rate = ( __rdtsc() - tsc ) / ( nowNs() - start );
+	}
+	return rate;
+}
+
+/* allocArray - cache line aligned array of bytes, exits on failure */
+void *allocArray( size_t bytes ) {
+	void *p;
+	if ( posix_memalign( &p, 64, bytes ) != 0 ) {
+		fprintf( stderr, "Cannot allocate %zu bytes\n", bytes );
+		exit( 1 );
+	}
+	return p;
+}
+
+/* allocPages - page aligned array of bytes backed by pages of the given
+ * kind: base pages only, transparent huge pages where the kernel grants
+ * them, or huge pages from the hugetlbfs pool.  Returns NULL and sets errno
+ * on failure (a hugetlb mapping fails unless vm.nr_hugepages reserves
+ * enough pages); free with freePages.
+ */
+void *allocPages( size_t bytes, int kind ) {
+	size_t huge = 2 << 20;
+	size_t len = ( bytes + huge - 1 ) & ~( huge - 1 );
+	if ( kind == PAGES_HUGETLB ) {
+		void *p = mmap( NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+		return p == MAP_FAILED ? NULL : p;
+	}
+
+	// huge pages only back whole, aligned 2 MiB ranges, so map an extra
+	// huge page and trim the mapping to an aligned start
+	char *p = mmap( NULL, len + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( p == MAP_FAILED ) {
+		return NULL;
+	}
+	char *start = ( char * ) ( ( ( size_t ) p + huge - 1 ) & ~( huge - 1 ) );
+	if ( start > p ) {
+		munmap( p, start - p );
+	}
+	munmap( start + len, p + huge - start );
+	madvise( start, len, kind == PAGES_THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE );
+	return start;
+}
+
+/* freePages - unmap an array from allocPages */
+void freePages( void *p, size_t bytes ) {
+	size_t huge = 2 << 20;
+	munmap( p, ( bytes + huge - 1 ) & ~( huge - 1 ) );
+}
+
+/* openCounter - open one user-space counter of the calling thread */
+static int openCounter( unsigned int type, unsigned long long config ) {
+	struct perf_event_attr attr;
+	memset( &attr, 0, sizeof( attr ) );
+	attr.size = sizeof( attr );
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+}
+
+/* openCounters - open every counter the machine provides.  Returns the
+ * number opened; when none can be, prints why once and the caller carries
+ * on with timing only.
+ */
+int openCounters( counters_t *c ) {
+	c->fds[COUNTER_CYCLES] = openCounter( PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES );
+	c->fds[COUNTER_CACHE_MISSES] = openCounter( PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES );
+	c->fds[COUNTER_DTLB_MISSES] = openCounter( PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+		PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+
+	int opened = 0;
+	for ( int i = 0; i < NUM_COUNTERS; i++ ) {
+		c->values[i] = 0;
+		opened += c->fds[i] >= 0;
+	}
+	if ( opened == 0 ) {
+		fprintf( stderr, "Hardware counters unavailable (%s), timing only\n",
+			strerror( errno ) );
+	}
+	return opened;
+}
+
+/* startCounters - reset and enable the open counters */
+void startCounters( counters_t *c ) {
+	for ( int i = 0; i < NUM_COUNTERS; i++ ) {
+		if ( c->fds[i] >= 0 ) {
+			ioctl( c->fds[i], PERF_EVENT_IOC_RESET, 0 );
+			ioctl( c->fds[i], PERF_EVENT_IOC_ENABLE, 0 );
+		}
+	}
+}
+
+/* stopCounters - disable the open counters and read their values */
+void stopCounters( counters_t *c ) {
+	for ( int i = 0; i < NUM_COUNTERS; i++ ) {
+		if ( c->fds[i] >= 0 ) {
+			ioctl( c->fds[i], PERF_EVENT_IOC_DISABLE, 0 );
+			if ( read( c->fds[i], &c->values[i], sizeof( c->values[i] ) ) !=
+					sizeof( c->values[i] ) ) {
+				c->values[i] = 0;
+			}
+		}
+	}
+}
+
+/* closeCounters - close the open counters */
+void closeCounters( counters_t *c ) {
+	for ( int i = 0; i < NUM_COUNTERS; i++ ) {
+		if ( c->fds[i] >= 0 ) {
+			close( c->fds[i] );
+			c->fds[i] = -1;
+		}
+	}
+}
@@ -0,0 +1,54 @@
+////////////////////////////////////////////////////////////////////////
+// Main File:        cachebench.c
+// This File:        bench.h
+// Other Files:      bench.c
+// Semester:         CS 354 Spring 2017
+//
+// Author:           Sean Kim
+// Email:            skim658@wisc.edu
+// CS Login:         seank
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef __bench_h__
+#define __bench_h__
+
+// Hardware counters read around a timed region
+typedef enum {
+	COUNTER_CYCLES = 0,
+	COUNTER_CACHE_MISSES,
+	COUNTER_DTLB_MISSES,
+	NUM_COUNTERS
+} counter_t;
+
+extern const char *counter_names[NUM_COUNTERS];
+
+// Page sizes an array can be backed by
+typedef enum {
+	PAGES_BASE = 0, // 4 KiB pages, transparent huge pages refused
+	PAGES_THP, // transparent huge pages (MADV_HUGEPAGE)
+	PAGES_HUGETLB, // reserved 2 MiB pages (MAP_HUGETLB)
+	NUM_PAGE_KINDS
+} page_kind_t;
+
+extern const char *page_kind_names[NUM_PAGE_KINDS];
+
+// Type: A set of perf_event_open counters.  fds[i] is -1 for a counter the
+// machine or kernel does not provide; values[i] holds the count of the last
+// startCounters/stopCounters region.
+typedef struct counters {
+	int fds[NUM_COUNTERS];
+	unsigned long long values[NUM_COUNTERS];
+} counters_t;
+
+double nowNs();
+double tscPerNs();
+void *allocArray( size_t bytes );
+void *allocPages( size_t bytes, int kind );
+void freePages( void *p, size_t bytes );
+int openCounters( counters_t *c );
+void startCounters( counters_t *c );
+void stopCounters( counters_t *c );
+void closeCounters( counters_t *c );
+
+#endif // __bench_h__
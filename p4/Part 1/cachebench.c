@@ -0,0 +1,313 @@
+////////////////////////////////////////////////////////////////////////
+// Main File:        cachebench.c
+// This File:        cachebench.c
+// Other Files:      bench.c, bench.h
+// Semester:         CS 354 Spring 2017
+//
+// Author:           Sean Kim
+// Email:            skim658@wisc.edu
+// CS Login:         seank
+//
+// The cache1D, cache2Drows and cache2Dcols loops as one timed benchmark.
+// Array dimensions, element type and traversal order are parameters, and
+// -S sweeps the working set from L1 sized to DRAM sized, printing the time
+// per element and the bytes stored per cycle at each size.  With -C the
+// cycle, cache miss and data TLB miss counters are read through
+// perf_event_open when the kernel allows it.
+//
+// Build:  gcc -std=gnu99 -O2 -o cachebench cachebench.c bench.c
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "bench.h"
+
+// Traversal orders, named as tracegen's kernels
+typedef enum {
+	ORDER_LINEAR = 0,
+	ORDER_ROWS,
+	ORDER_COLS,
+	NUM_ORDERS
+} order_t;
+
+const char *order_names[NUM_ORDERS] = { "linear", "rows", "cols" };
+
+// Element types
+typedef enum {
+	TYPE_CHAR = 0,
+	TYPE_SHORT,
+	TYPE_INT,
+	TYPE_LONG,
+	TYPE_FLOAT,
+	TYPE_DOUBLE,
+	NUM_TYPES
+} type_t;
+
+const char *type_names[NUM_TYPES] = { "char", "short", "int", "long", "float", "double" };
+const size_t type_sizes[NUM_TYPES] = { sizeof( char ), sizeof( short ), sizeof( int ),
+	sizeof( long ), sizeof( float ), sizeof( double ) };
+
+// A kernel stores to every element of a rows x cols array once
+typedef void ( *kernel_fn )( void *arr, size_t rows, size_t cols );
+
+// linear is cache1D's loop over the array as one row, rows and cols are the
+// loops of cache2Drows and cache2Dcols
+#define DEFINE_KERNELS( T ) \
+	static void linear_##T( void *a, size_t rows, size_t cols ) { \
+		T *arr = a; \
+		size_t n = rows * cols; \
+		for ( size_t i = 0; i < n; i++ ) { \
+			arr[i] = ( T ) i; \
+		} \
+	} \
+	static void rows_##T( void *a, size_t rows, size_t cols ) { \
+		T *arr = a; \
+		for ( size_t i = 0; i < rows; i++ ) { \
+			for ( size_t k = 0; k < cols; k++ ) { \
+				arr[i * cols + k] = ( T ) ( i + k ); \
+			} \
+		} \
+	} \
+	static void cols_##T( void *a, size_t rows, size_t cols ) { \
+		T *arr = a; \
+		for ( size_t i = 0; i < cols; i++ ) { \
+			for ( size_t j = 0; j < rows; j++ ) { \
+				arr[j * cols + i] = ( T ) ( i + j ); \
+			} \
+		} \
+	}
+
+DEFINE_KERNELS( char )
+DEFINE_KERNELS( short )
+DEFINE_KERNELS( int )
+DEFINE_KERNELS( long )
+DEFINE_KERNELS( float )
+DEFINE_KERNELS( double )
+
+#define KERNEL_ROW( O ) { O##_char, O##_short, O##_int, O##_long, O##_float, O##_double }
+
+kernel_fn kernels[NUM_ORDERS][NUM_TYPES] = {
+	KERNEL_ROW( linear ),
+	KERNEL_ROW( rows ),
+	KERNEL_ROW( cols )
+};
+
+// Globals set by command line args
+int order = ORDER_LINEAR;
+int type = TYPE_INT;
+size_t rows = 3000; // 2D orders: array dimensions
+size_t cols = 500;
+size_t elements = 100000; // linear: array length
+int trials = 5; // timed runs per size, the fastest is reported
+int use_counters = 0;
+int sweep = 0;
+size_t sweep_min = 4096; // sweep: smallest and largest working set in bytes
+size_t sweep_max = 256 << 20;
+size_t min_stores = 1 << 24; // small arrays are rerun to at least this many stores
+
+// Counters opened by -C
+counters_t counters;
+int counters_open = 0;
+
+// Type: Result of timing one array size
+typedef struct result {
+	double ns; // fastest trial, per kernel run
+	double cycles; // cycles of that trial per kernel run
+	double counts[NUM_COUNTERS]; // counter values of that trial per kernel run
+} result_t;
+
+/* measure - time the selected kernel over an r x c array.  The array is
+ * written once untimed so page faults are not counted.
+ */
+result_t measure( size_t r, size_t c ) {
+	size_t n = r * c;
+	kernel_fn kernel = kernels[order][type];
+	void *arr = allocArray( n * type_sizes[type] );
+	size_t reps = n < min_stores ? min_stores / n : 1;
+	result_t best;
+
+	kernel( arr, r, c );
+	best.ns = 0;
+	for ( int t = 0; t < trials; t++ ) {
+		if ( counters_open ) {
+			startCounters( &counters );
+		}
+		double start = nowNs();
+		for ( size_t i = 0; i < reps; i++ ) {
+			kernel( arr, r, c );
+		}
+		double ns = ( nowNs() - start ) / reps;
+		if ( counters_open ) {
+			stopCounters( &counters );
+		}
+		if ( best.ns == 0 || ns < best.ns ) {
+			best.ns = ns;
+			for ( int i = 0; i < NUM_COUNTERS; i++ ) {
+				best.counts[i] = ( double ) counters.values[i] / reps;
+			}
+		}
+	}
+	free( arr );
+
+	// without a cycle counter, cycles are time stamp counter ticks
+	best.cycles = counters_open && counters.fds[COUNTER_CYCLES] >= 0 ?
+		best.counts[COUNTER_CYCLES] : best.ns * tscPerNs();
+	return best;
+}
+
+/* printHeader - print the column names of the result table */
+void printHeader() {
+	printf( "%12s %10s %10s %10s %12s", "bytes", "rows", "cols", "ns/elem", "bytes/cycle" );
+	for ( int i = 0; counters_open && i < NUM_COUNTERS; i++ ) {
+		if ( i != COUNTER_CYCLES && counters.fds[i] >= 0 ) {
+			printf( " %13s/elem", counter_names[i] );
+		}
+	}
+	printf( "\n" );
+}
+
+/* printResult - print one row of the result table */
+void printResult( size_t r, size_t c, result_t *res ) {
+	size_t n = r * c;
+	size_t bytes = n * type_sizes[type];
+	printf( "%12zu %10zu %10zu %10.3f %12.3f", bytes, r, c, res->ns / n,
+		bytes / res->cycles );
+	for ( int i = 0; counters_open && i < NUM_COUNTERS; i++ ) {
+		if ( i != COUNTER_CYCLES && counters.fds[i] >= 0 ) {
+			printf( " %18.4f", res->counts[i] / n );
+		}
+	}
+	printf( "\n" );
+}
+
+/* dimensions - array shape holding about bytes bytes.  Linear arrays are
+ * one row; 2D arrays keep their column count and grow in rows.
+ */
+void dimensions( size_t bytes, size_t *r, size_t *c ) {
+	size_t n = bytes / type_sizes[type];
+	if ( n == 0 ) {
+		n = 1;
+	}
+	if ( order == ORDER_LINEAR ) {
+		*r = 1;
+		*c = n;
+	} else {
+		*c = cols;
+		*r = n / cols ? n / cols : 1;
+	}
+}
+
+/* lookupName - index of name in names, or -1 */
+int lookupName( const char *name, const char **names, int count ) {
+	for ( int i = 0; i < count; i++ ) {
+		if ( strcmp( name, names[i] ) == 0 ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* printUsage - print usage info */
+void printUsage( char *argv[] ) {
+	printf( "Usage: %s [-hCS] [-k <order>] [-e <type>] [-n <num>] [-r <num>] [-c <num>]\n", argv[0] );
+	printf( "          [-p <num>] [-m <bytes>] [-M <bytes>]\n" );
+	printf( "Options:\n" );
+	printf( "  -h         Print this help message.\n" );
+	printf( "  -k <name>  Traversal order: linear (default), rows or cols.\n" );
+	printf( "  -e <type>  Element type: char, short, int (default), long, float, double.\n" );
+	printf( "  -n <num>   Elements of the 1D array (linear, default 100000).\n" );
+	printf( "  -r <num>   Rows of the 2D array (rows, cols, default 3000).\n" );
+	printf( "  -c <num>   Columns of the 2D array (rows, cols, default 500).\n" );
+	printf( "  -p <num>   Timed trials per size, the fastest is reported (default 5).\n" );
+	printf( "  -C         Read hardware counters with perf_event_open.\n" );
+	printf( "  -S         Sweep the working set from -m to -M bytes, doubling.\n" );
+	printf( "  -m <bytes> Smallest working set of the sweep (default 4096).\n" );
+	printf( "  -M <bytes> Largest working set of the sweep (default 268435456).\n" );
+	printf( "\nExamples:\n" );
+	printf( "  linux>  %s -k cols -r 3000 -c 500 -C\n", argv[0] );
+	printf( "  linux>  %s -S -k rows -e double -M 1073741824\n", argv[0] );
+	exit( 0 );
+}
+
+int main( int argc, char *argv[] ) {
+	int c;
+
+	while ( ( c = getopt( argc, argv, "hk:e:n:r:c:p:CSm:M:" ) ) != -1 ) {
+		switch ( c ) {
+		case 'k':
+			order = lookupName( optarg, order_names, NUM_ORDERS );
+			if ( order < 0 ) {
+				printf( "%s: Unknown order %s\n", argv[0], optarg );
+				printUsage( argv );
+			}
+			break;
+		case 'e':
+			type = lookupName( optarg, type_names, NUM_TYPES );
+			if ( type < 0 ) {
+				printf( "%s: Unknown type %s\n", argv[0], optarg );
+				printUsage( argv );
+			}
+			break;
+		case 'n':
+			elements = strtoull( optarg, NULL, 10 );
+			break;
+		case 'r':
+			rows = strtoull( optarg, NULL, 10 );
+			break;
+		case 'c':
+			cols = strtoull( optarg, NULL, 10 );
+			break;
+		case 'p':
+			trials = atoi( optarg );
+			break;
+		case 'C':
+			use_counters = 1;
+			break;
+		case 'S':
+			sweep = 1;
+			break;
+		case 'm':
+			sweep_min = strtoull( optarg, NULL, 10 );
+			break;
+		case 'M':
+			sweep_max = strtoull( optarg, NULL, 10 );
+			break;
+		default:
+			printUsage( argv );
+		}
+	}
+
+	if ( elements == 0 || rows == 0 || cols == 0 || trials <= 0 || sweep_min == 0 ) {
+		printf( "%s: Sizes and trials must be positive\n", argv[0] );
+		exit( 1 );
+	}
+	if ( use_counters ) {
+		counters_open = openCounters( &counters ) > 0;
+	}
+
+	printf( "order:%s type:%s\n", order_names[order], type_names[type] );
+	printHeader();
+	if ( sweep ) {
+		for ( size_t bytes = sweep_min; bytes <= sweep_max; bytes *= 2 ) {
+			size_t r, cl;
+			dimensions( bytes, &r, &cl );
+			result_t res = measure( r, cl );
+			printResult( r, cl, &res );
+			fflush( stdout );
+		}
+	} else {
+		size_t r = order == ORDER_LINEAR ? 1 : rows;
+		size_t cl = order == ORDER_LINEAR ? elements : cols;
+		result_t res = measure( r, cl );
+		printResult( r, cl, &res );
+	}
+
+	if ( counters_open ) {
+		closeCounters( &counters );
+	}
+	return 0;
+}
@@ -0,0 +1,249 @@
+////////////////////////////////////////////////////////////////////////
+// Main File:        cachefill.c
+// This File:        cachefill.c
+// Other Files:      bench.c, bench.h
+// Semester:         CS 354 Spring 2017
+//
+// Author:           Sean Kim
+// Email:            skim658@wisc.edu
+// CS Login:         seank
+//
+// cache1D's arr[i] = i fill written out explicitly: a scalar loop, SSE and
+// AVX2 vector stores, SSE and AVX2 non-temporal (streaming) stores that
+// write around the caches, and memset.  Each is timed over working sets
+// from well inside the caches to well past the last level cache, to show
+// where streaming stores start beating cached ones for large buffers.
+// memset stores zeros, everything else stores the index.
+//
+// Build:  gcc -std=gnu99 -O2 -o cachefill cachefill.c bench.c
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <immintrin.h>
+
+#include "bench.h"
+
+// Globals set by command line args
+size_t sweep_min = 16 << 10; // smallest and largest working set in bytes
+size_t sweep_max = 512 << 20;
+int trials = 3; // timed runs per size, the fastest is reported
+size_t min_bytes = 256 << 20; // small arrays are refilled to at least this many bytes
+
+// A fill stores to all n ints of the 64 byte aligned array a
+typedef void ( *fill_fn )( int *a, size_t n );
+
+/* fillScalar - one int per store, kept from being vectorized */
+__attribute__( ( optimize( "no-tree-vectorize" ) ) )
+void fillScalar( int *a, size_t n ) {
+	for ( size_t i = 0; i < n; i++ ) {
+		a[i] = i;
+	}
+}
+
+/* fillSse - four ints per aligned 16 byte store */
+void fillSse( int *a, size_t n ) {
+	__m128i v = _mm_setr_epi32( 0, 1, 2, 3 );
+	__m128i step = _mm_set1_epi32( 4 );
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 ) {
+		_mm_store_si128( ( __m128i * ) ( a + i ), v );
+		v = _mm_add_epi32( v, step );
+	}
+	for ( ; i < n; i++ ) {
+		a[i] = i;
+	}
+}
+
+/* fillStreamSse - fillSse with non-temporal stores */
+void fillStreamSse( int *a, size_t n ) {
+	__m128i v = _mm_setr_epi32( 0, 1, 2, 3 );
+	__m128i step = _mm_set1_epi32( 4 );
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 ) {
+		_mm_stream_si128( ( __m128i * ) ( a + i ), v );
+		v = _mm_add_epi32( v, step );
+	}
+	_mm_sfence();
+	for ( ; i < n; i++ ) {
+		a[i] = i;
+	}
+}
+
+/* fillAvx2 - eight ints per aligned 32 byte store */
+__attribute__( ( target( "avx2" ) ) )
+void fillAvx2( int *a, size_t n ) {
+	__m256i v = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+	__m256i step = _mm256_set1_epi32( 8 );
+	size_t i = 0;
+	for ( ; i + 8 <= n; i += 8 ) {
+		_mm256_store_si256( ( __m256i * ) ( a + i ), v );
+		v = _mm256_add_epi32( v, step );
+	}
+	for ( ; i < n; i++ ) {
+		a[i] = i;
+	}
+}
+
+/* fillStreamAvx2 - fillAvx2 with non-temporal stores */
+__attribute__( ( target( "avx2" ) ) )
+void fillStreamAvx2( int *a, size_t n ) {
+	__m256i v = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+	__m256i step = _mm256_set1_epi32( 8 );
+	size_t i = 0;
+	for ( ; i + 8 <= n; i += 8 ) {
+		_mm256_stream_si256( ( __m256i * ) ( a + i ), v );
+		v = _mm256_add_epi32( v, step );
+	}
+	_mm_sfence();
+	for ( ; i < n; i++ ) {
+		a[i] = i;
+	}
+}
+
+/* fillMemset - libc's bulk fill, which picks its own store width and
+ * switches to non-temporal stores for very large buffers
+ */
+void fillMemset( int *a, size_t n ) {
+	memset( a, 0, n * sizeof( int ) );
+}
+
+// Type: A fill kernel and whether this CPU can run it
+typedef struct fill {
+	const char *name;
+	fill_fn fn;
+	int avx2;
+} fill_t;
+
+fill_t fills[] = {
+	{ "scalar", fillScalar, 0 },
+	{ "sse", fillSse, 0 },
+	{ "avx2", fillAvx2, 1 },
+	{ "stream-sse", fillStreamSse, 0 },
+	{ "stream-avx2", fillStreamAvx2, 1 },
+	{ "memset", fillMemset, 0 },
+};
+
+#define NUM_FILLS ( sizeof( fills ) / sizeof( fills[0] ) )
+
+/* check - run f once and verify the array */
+int check( fill_t *f, int *a, size_t n ) {
+	f->fn( a, n );
+	for ( size_t i = 0; i < n; i++ ) {
+		if ( a[i] != ( f->fn == fillMemset ? 0 : ( int ) i ) ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* measure - GB/s of the fastest of trials fills of n ints.  The array is
+ * filled once untimed so page faults are not counted.
+ */
+double measure( fill_t *f, int *a, size_t n ) {
+	size_t bytes = n * sizeof( int );
+	size_t reps = bytes < min_bytes ? min_bytes / bytes : 1;
+	double best = 0;
+
+	f->fn( a, n );
+	for ( int t = 0; t < trials; t++ ) {
+		double start = nowNs();
+		for ( size_t i = 0; i < reps; i++ ) {
+			f->fn( a, n );
+		}
+		double ns = ( nowNs() - start ) / reps;
+		if ( best == 0 || ns < best ) {
+			best = ns;
+		}
+	}
+	return bytes / best;
+}
+
+/* printUsage - print usage info */
+void printUsage( char *argv[] ) {
+	printf( "Usage: %s [-h] [-m <bytes>] [-M <bytes>] [-p <num>]\n", argv[0] );
+	printf( "Options:\n" );
+	printf( "  -h         Print this help message.\n" );
+	printf( "  -m <bytes> Smallest working set (default 16384).\n" );
+	printf( "  -M <bytes> Largest working set (default 536870912).\n" );
+	printf( "  -p <num>   Timed runs per size, the fastest is reported (default 3).\n" );
+	printf( "\nSizes double from -m to -M; GB/s is printed for each kernel, and sizes\n" );
+	printf( "larger than the last level cache are marked with *.\n" );
+	printf( "\nExamples:\n" );
+	printf( "  linux>  %s -M 2147483648\n", argv[0] );
+	exit( 0 );
+}
+
+int main( int argc, char *argv[] ) {
+	int c;
+
+	while ( ( c = getopt( argc, argv, "hm:M:p:" ) ) != -1 ) {
+		switch ( c ) {
+		case 'm':
+			sweep_min = strtoull( optarg, NULL, 10 );
+			break;
+		case 'M':
+			sweep_max = strtoull( optarg, NULL, 10 );
+			break;
+		case 'p':
+			trials = atoi( optarg );
+			break;
+		default:
+			printUsage( argv );
+		}
+	}
+
+	if ( sweep_min < 64 || sweep_max < sweep_min || trials <= 0 ) {
+		printf( "%s: Sizes must be at least 64 bytes, trials positive\n", argv[0] );
+		exit( 1 );
+	}
+
+	int avx2 = __builtin_cpu_supports( "avx2" );
+	long llc = sysconf( _SC_LEVEL3_CACHE_SIZE );
+	size_t check_n = 1001;
+	int *a = allocArray( sweep_max > check_n * sizeof( int ) ? sweep_max : check_n * sizeof( int ) );
+
+	// the kernels are checked on an odd length so the scalar tails run too
+	for ( size_t i = 0; i < NUM_FILLS; i++ ) {
+		if ( ( avx2 || !fills[i].avx2 ) && !check( &fills[i], a, check_n ) ) {
+			printf( "%s: wrong result\n", fills[i].name );
+			exit( 1 );
+		}
+	}
+
+	if ( llc > 0 ) {
+		printf( "last level cache: %ld KiB\n", llc >> 10 );
+	}
+	printf( "%13s", "bytes" );
+	for ( size_t i = 0; i < NUM_FILLS; i++ ) {
+		printf( " %11s", fills[i].name );
+	}
+	printf( "  %s\n", "fastest (GB/s)" );
+	for ( size_t bytes = sweep_min; bytes <= sweep_max; bytes *= 2 ) {
+		size_t n = bytes / sizeof( int );
+		double best = 0;
+		const char *fastest = NULL;
+		printf( "%12zu%c", bytes, llc > 0 && bytes > ( size_t ) llc ? '*' : ' ' );
+		for ( size_t i = 0; i < NUM_FILLS; i++ ) {
+			if ( fills[i].avx2 && !avx2 ) {
+				printf( " %11s", "-" );
+				continue;
+			}
+			double gbs = measure( &fills[i], a, n );
+			printf( " %11.2f", gbs );
+			if ( gbs > best ) {
+				best = gbs;
+				fastest = fills[i].name;
+			}
+			fflush( stdout );
+		}
+		printf( "  %s\n", fastest );
+	}
+
+	free( a );
+	return 0;
+}
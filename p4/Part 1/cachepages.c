@@ -0,0 +1,183 @@
+////////////////////////////////////////////////////////////////////////
+// Main File:        cachepages.c
+// This File:        cachepages.c
+// Other Files:      bench.c, bench.h
+// Semester:         CS 354 Spring 2017
+//
+// Author:           Sean Kim
+// Email:            skim658@wisc.edu
+// CS Login:         seank
+//
+// The cache2Drows and cache2Dcols loops over arrays backed by 4 KiB base
+// pages, transparent huge pages (MADV_HUGEPAGE) and reserved huge pages
+// (MAP_HUGETLB).  With 500 int columns the column walk moves to a new 4 KiB
+// page every other store, so it is a TLB stress test; 2 MiB pages cover
+// 500 times as much memory per TLB entry.  The rows are scaled from
+// arr2Dcols' 3000 by 8 at a time up to -M bytes, and each run prints how
+// much of the array the kernel really backed with huge pages.
+//
+// MAP_HUGETLB needs pages reserved first, e.g.
+//   echo 1024 > /proc/sys/vm/nr_hugepages
+//
+// Build:  gcc -std=gnu99 -O2 -o cachepages cachepages.c bench.c
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#include "bench.h"
+
+// Globals set by command line args
+size_t rows = 3000; // smallest array, as arr2Dcols
+size_t cols = 500;
+size_t max_bytes = 1 << 30; // largest array
+size_t scale = 8; // rows grow by this factor between sizes
+int trials = 1; // timed runs per walk, the fastest is reported
+
+/* walkRows - cache2Drows' loop */
+void walkRows( int *a, size_t r, size_t c ) {
+	for ( size_t i = 0; i < r; i++ ) {
+		for ( size_t k = 0; k < c; k++ ) {
+			a[i * c + k] = i + k;
+		}
+	}
+}
+
+/* walkCols - cache2Dcols' loop */
+void walkCols( int *a, size_t r, size_t c ) {
+	for ( size_t i = 0; i < c; i++ ) {
+		for ( size_t j = 0; j < r; j++ ) {
+			a[j * c + i] = i + j;
+		}
+	}
+}
+
+/* measure - ms of the fastest of trials runs of walk */
+double measure( void ( *walk )( int *, size_t, size_t ), int *a, size_t r, size_t c ) {
+	double best = 0;
+	for ( int t = 0; t < trials; t++ ) {
+		double start = nowNs();
+		walk( a, r, c );
+		double ns = nowNs() - start;
+		if ( best == 0 || ns < best ) {
+			best = ns;
+		}
+	}
+	return best / 1e6;
+}
+
+/* hugeBytes - bytes of the mapping starting at p backed by huge pages,
+ * from /proc/self/smaps, or -1 if it cannot be read
+ */
+long long hugeBytes( void *p ) {
+	FILE *fp = fopen( "/proc/self/smaps", "r" );
+	char line[256];
+	int inside = 0;
+	long long kb = -1;
+
+	if ( fp == NULL ) {
+		return -1;
+	}
+	while ( fgets( line, sizeof( line ), fp ) != NULL ) {
+		unsigned long start, end;
+		long long value;
+		if ( sscanf( line, "%lx-%lx ", &start, &end ) == 2 ) {
+			inside = start == ( unsigned long ) p;
+			if ( inside ) {
+				kb = 0;
+			}
+		} else if ( inside && ( sscanf( line, "AnonHugePages: %lld kB", &value ) == 1 ||
+				sscanf( line, "Private_Hugetlb: %lld kB", &value ) == 1 ) ) {
+			kb += value;
+		}
+	}
+	fclose( fp );
+	return kb < 0 ? -1 : kb * 1024;
+}
+
+/* printUsage - print usage info */
+void printUsage( char *argv[] ) {
+	printf( "Usage: %s [-h] [-r <num>] [-c <num>] [-x <num>] [-M <bytes>] [-p <num>]\n", argv[0] );
+	printf( "Options:\n" );
+	printf( "  -h         Print this help message.\n" );
+	printf( "  -r <num>   Rows of the smallest array (default 3000).\n" );
+	printf( "  -c <num>   Columns (default 500).\n" );
+	printf( "  -x <num>   Factor the rows grow by between sizes (default 8).\n" );
+	printf( "  -M <bytes> Largest array (default 1073741824).\n" );
+	printf( "  -p <num>   Timed runs per walk, the fastest is reported (default 1).\n" );
+	printf( "\nExamples:\n" );
+	printf( "  linux>  %s -M 4294967296\n", argv[0] );
+	exit( 0 );
+}
+
+int main( int argc, char *argv[] ) {
+	int c;
+
+	while ( ( c = getopt( argc, argv, "hr:c:x:M:p:" ) ) != -1 ) {
+		switch ( c ) {
+		case 'r':
+			rows = strtoull( optarg, NULL, 10 );
+			break;
+		case 'c':
+			cols = strtoull( optarg, NULL, 10 );
+			break;
+		case 'x':
+			scale = strtoull( optarg, NULL, 10 );
+			break;
+		case 'M':
+			max_bytes = strtoull( optarg, NULL, 10 );
+			break;
+		case 'p':
+			trials = atoi( optarg );
+			break;
+		default:
+			printUsage( argv );
+		}
+	}
+
+	if ( rows == 0 || cols == 0 || scale < 2 || trials <= 0 ) {
+		printf( "%s: Sizes and trials must be positive, the scale at least 2\n", argv[0] );
+		exit( 1 );
+	}
+
+	printf( "%12s %10s %6s %8s %6s %10s %10s %8s %8s\n", "bytes", "rows", "cols",
+		"pages", "huge%", "rows ms", "cols ms", "rows x", "cols x" );
+	for ( size_t r = rows; r * cols * sizeof( int ) <= max_bytes; r *= scale ) {
+		size_t bytes = r * cols * sizeof( int );
+		double base_rows = 0, base_cols = 0;
+		for ( int kind = 0; kind < NUM_PAGE_KINDS; kind++ ) {
+			printf( "%12zu %10zu %6zu %8s ", bytes, r, cols, page_kind_names[kind] );
+			int *a = allocPages( bytes, kind );
+			if ( a == NULL ) {
+				printf( "unavailable (%s)\n", strerror( errno ) );
+				continue;
+			}
+
+			// fault every page in untimed, then read back what backs it
+			memset( a, 0, bytes );
+			long long huge = hugeBytes( a );
+			double ms_rows = measure( walkRows, a, r, cols );
+			double ms_cols = measure( walkCols, a, r, cols );
+			if ( kind == PAGES_BASE ) {
+				base_rows = ms_rows;
+				base_cols = ms_cols;
+			}
+			if ( huge < 0 ) {
+				printf( "%6s", "?" );
+			} else {
+				// the mapping is rounded up to whole huge pages
+				double backed = ( double ) ( huge < ( long long ) bytes ? huge : ( long long ) bytes );
+				printf( "%5.0f%%", 100.0 * backed / bytes );
+			}
+			printf( " %10.1f %10.1f %7.2fx %7.2fx\n", ms_rows, ms_cols,
+				base_rows / ms_rows, base_cols / ms_cols );
+			fflush( stdout );
+			freePages( a, bytes );
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,374 @@
+////////////////////////////////////////////////////////////////////////
+// Main File:        cacheprobe.c
+// This File:        cacheprobe.c
+// Other Files:      bench.c, bench.h
+// Semester:         CS 354 Spring 2017
+//
+// Author:           Sean Kim
+// Email:            skim658@wisc.edu
+// CS Login:         seank
+//
+// Measures the load latency of dependent pointer chasing around rings of
+// randomly ordered nodes to infer the data caches of the machine it runs
+// on, and prints csim command lines that simulate them.
+//
+//  - Line size: rings of two loads d bytes apart in each of many random
+//    1 KiB chunks.  The second load hits while d is inside the line, so the
+//    latency steps up where d reaches the line size.
+//  - Capacity: rings of one node per line over growing working sets.  Each
+//    level's capacity is the last size before the steepest rise off its
+//    plateau.  Replacement is not true LRU, so a ring exactly the size of a
+//    cache can already spill and the size may be one step low.
+//  - Associativity: rings of k nodes spaced one cache size apart, which all
+//    fall in one set.  The latency jumps once k exceeds the ways.  Lower
+//    levels hide a level with fewer ways, and sliced last level caches hash
+//    the set, so this is approximate and printed as ? when no jump is seen.
+//
+// The associativity rings are backed by transparent huge pages where
+// possible, so nodes one cache size apart do not also collide in one TLB set
+// and set indexes follow the virtual address in physically indexed caches.
+//
+// Build:  gcc -std=gnu99 -O2 -o cacheprobe cacheprobe.c bench.c
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "bench.h"
+
+#define MAX_LEVELS 3
+#define MAX_WAYS 32
+#define CHUNK 1024 // line size probe: bytes per chunk, the largest line found
+#define KNEE 1.3 // latency ratio that ends a plateau
+
+// Globals set by command line args
+size_t min_bytes = 1024; // smallest and largest capacity probe working set
+size_t max_bytes = 256 << 20;
+int trials = 3; // timed runs per ring, the fastest is reported
+int verbose = 0; // print every measurement
+size_t min_loads = 1 << 21; // loads per timed run, at least one lap of the ring
+
+// Type: A cache level found by the probe, 0 where unknown
+typedef struct level {
+	size_t size;
+	int ways;
+	double ns; // load latency on the level's plateau
+} level_t;
+
+unsigned long long rng_state = 0x2545F4914F6CDD1DULL;
+
+// Keeps the end of each chase live so the loads are not optimized away
+void *volatile sink;
+
+/* nextRandom - xorshift64 step of the generator */
+static inline unsigned long long nextRandom() {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+/* shuffle - Fisher-Yates shuffle of n offsets */
+void shuffle( size_t *a, size_t n ) {
+	for ( size_t i = n - 1; i > 0; i-- ) {
+		size_t j = nextRandom() % ( i + 1 );
+		size_t tmp = a[i];
+		a[i] = a[j];
+		a[j] = tmp;
+	}
+}
+
+/* mapArray - bytes backed by transparent huge pages, exits on failure */
+char *mapArray( size_t bytes ) {
+	char *p = allocPages( bytes, PAGES_THP );
+	if ( p == NULL ) {
+		fprintf( stderr, "Cannot map %zu bytes\n", bytes );
+		exit( 1 );
+	}
+	return p;
+}
+
+/* chase - follow the ring from p for loads loads (a multiple of 8) */
+static void **chase( void **p, size_t loads ) {
+	for ( size_t i = 0; i < loads; i += 8 ) {
+		p = *p; p = *p; p = *p; p = *p;
+		p = *p; p = *p; p = *p; p = *p;
+	}
+	return p;
+}
+
+/* ringLatency - link the nodes at the n offsets of buf into a ring in the
+ * given order and return the fastest ns per load of chasing it
+ */
+double ringLatency( char *buf, size_t *order, size_t n ) {
+	for ( size_t i = 0; i < n; i++ ) {
+		*( void ** ) ( buf + order[i] ) = buf + order[( i + 1 ) % n];
+	}
+	size_t loads = ( ( n > min_loads ? n : min_loads ) + 7 ) & ~( size_t ) 7;
+	void **p = chase( ( void ** ) ( buf + order[0] ), n + 8 - n % 8 );
+	double best = 0;
+	for ( int t = 0; t < trials; t++ ) {
+		double start = nowNs();
+		p = chase( p, loads );
+		double ns = ( nowNs() - start ) / loads;
+		if ( best == 0 || ns < best ) {
+			best = ns;
+		}
+	}
+	sink = p;
+	return best;
+}
+
+/* probeLine - line size in bytes, from pairs of loads d apart in random
+ * chunks of a 4 MiB array.  The line size is the d with the largest rise in
+ * latency over d / 2.
+ */
+size_t probeLine() {
+	size_t bytes = 4 << 20;
+	size_t chunks = bytes / CHUNK;
+	char *buf = mapArray( bytes );
+	size_t *base = malloc( sizeof( size_t ) * chunks );
+	size_t *order = malloc( sizeof( size_t ) * chunks * 2 );
+	size_t line = 0;
+	double prev = 0, best = 0;
+
+	for ( size_t i = 0; i < chunks; i++ ) {
+		base[i] = i * CHUNK;
+	}
+	shuffle( base, chunks );
+	for ( size_t d = 8; d < CHUNK; d *= 2 ) {
+		for ( size_t i = 0; i < chunks; i++ ) {
+			order[2 * i] = base[i];
+			order[2 * i + 1] = base[i] + d;
+		}
+		double ns = ringLatency( buf, order, chunks * 2 );
+		if ( verbose ) {
+			printf( "line   d:%-10zu %8.2f ns\n", d, ns );
+		}
+		if ( prev != 0 && ns / prev > best ) {
+			best = ns / prev;
+			line = d;
+		}
+		prev = ns;
+	}
+
+	free( order );
+	free( base );
+	freePages( buf, bytes );
+	return line;
+}
+
+/* probeCapacity - fill levels with the capacities and latencies of up to
+ * MAX_LEVELS caches from random rings of one node per line, over sizes
+ * stepping by 2^k and 1.5 * 2^k bytes.  A level ends where the latency
+ * rises by more than KNEE over a run of rising steps; its capacity is the
+ * size before the steepest step of the run.  Returns the levels found.
+ */
+int probeCapacity( size_t line, level_t *levels ) {
+	char *buf = allocArray( max_bytes );
+	size_t *order = malloc( sizeof( size_t ) * ( max_bytes / line ) );
+	int found = 0;
+	double prev = 0;
+	size_t prev_bytes = 0;
+	double run_start = 0, steepest = 0; // current run of rising steps
+	size_t knee = 0;
+
+	for ( size_t pow2 = min_bytes; pow2 <= max_bytes; pow2 *= 2 ) {
+		for ( int half = 0; half < 2; half++ ) {
+			size_t bytes = half ? pow2 + pow2 / 2 : pow2;
+			size_t n = bytes / line;
+			if ( bytes > max_bytes || n < 2 ) {
+				continue;
+			}
+			for ( size_t i = 0; i < n; i++ ) {
+				order[i] = i * line;
+			}
+			shuffle( order, n );
+			double ns = ringLatency( buf, order, n );
+			if ( verbose ) {
+				printf( "size   bytes:%-10zu %8.2f ns\n", bytes, ns );
+				fflush( stdout );
+			}
+
+			if ( prev != 0 && ns > prev * 1.1 ) {
+				if ( run_start == 0 ) {
+					run_start = prev;
+					steepest = 0;
+				}
+				if ( ns / prev > steepest ) {
+					steepest = ns / prev;
+					knee = prev_bytes;
+				}
+			} else if ( run_start != 0 ) {
+				// flat again: a big enough run was a level boundary
+				if ( prev > run_start * KNEE && found < MAX_LEVELS ) {
+					levels[found].size = knee;
+					levels[found].ns = run_start;
+					found++;
+				}
+				run_start = 0;
+			}
+			prev = ns;
+			prev_bytes = bytes;
+		}
+	}
+
+	free( order );
+	free( buf );
+	return found;
+}
+
+/* probeWays - associativity of the level whose capacity is size, from
+ * rings of k nodes size bytes apart, starting above the ways of the level
+ * below (lower) so its hits do not hide the knee.  Returns 0 if no knee is
+ * found or the rings do not fit in max_bytes.
+ */
+int probeWays( size_t size, int lower ) {
+	size_t bytes = size * ( MAX_WAYS + 1 );
+	if ( bytes > max_bytes ) {
+		return 0;
+	}
+	char *buf = mapArray( bytes );
+	size_t order[MAX_WAYS + 1];
+	double base = 0;
+	int ways = 0;
+
+	for ( int k = 1; k <= MAX_WAYS + 1 && ways == 0; k++ ) {
+		for ( int i = 0; i < k; i++ ) {
+			order[i] = i * size;
+		}
+		double ns = ringLatency( buf, order, k );
+		if ( verbose ) {
+			printf( "ways   size:%-10zu k:%-3d %8.2f ns\n", size, k, ns );
+		}
+		if ( k <= lower ) {
+			continue;
+		}
+		if ( base == 0 ) {
+			base = ns;
+		} else if ( ns > base * KNEE ) {
+			ways = k - 1;
+		}
+	}
+
+	freePages( buf, bytes );
+	return ways;
+}
+
+/* log2Exact - log2 of n if n is a power of 2, else -1 */
+int log2Exact( size_t n ) {
+	if ( n == 0 || ( n & ( n - 1 ) ) != 0 ) {
+		return -1;
+	}
+	return __builtin_ctzll( n );
+}
+
+/* printSize - print bytes in KiB or MiB */
+void printSize( size_t bytes ) {
+	if ( bytes >= ( 1 << 20 ) && bytes % ( 1 << 20 ) == 0 ) {
+		printf( "%6zu MiB", bytes >> 20 );
+	} else {
+		printf( "%6zu KiB", bytes >> 10 );
+	}
+}
+
+/* printCsim - print a csim command line simulating a level.  Set counts
+ * that are not a power of 2 use -S; unknown ways are guessed as 8.
+ */
+void printCsim( const char *name, level_t *lv, size_t line ) {
+	int ways = lv->ways ? lv->ways : 8;
+	size_t sets = lv->size / ( ways * line );
+	int s = log2Exact( sets );
+	printf( "  %-4s ./csim ", name );
+	if ( s >= 0 ) {
+		printf( "-s %d", s );
+	} else {
+		printf( "-S %zu", sets ? sets : 1 );
+	}
+	printf( " -E %d -b %d -t <tracefile>%s\n", ways, log2Exact( line ),
+		lv->ways ? "" : "   (ways guessed)" );
+}
+
+/* printUsage - print usage info */
+void printUsage( char *argv[] ) {
+	printf( "Usage: %s [-hv] [-m <bytes>] [-M <bytes>] [-p <num>]\n", argv[0] );
+	printf( "Options:\n" );
+	printf( "  -h         Print this help message.\n" );
+	printf( "  -v         Print every latency measured.\n" );
+	printf( "  -m <bytes> Smallest working set probed (default 1024).\n" );
+	printf( "  -M <bytes> Largest working set probed (default 268435456); raise it\n" );
+	printf( "             above the last level cache size to find that level.\n" );
+	printf( "  -p <num>   Timed runs per ring, the fastest is reported (default 3).\n" );
+	printf( "\nExamples:\n" );
+	printf( "  linux>  %s -M 1073741824\n", argv[0] );
+	exit( 0 );
+}
+
+int main( int argc, char *argv[] ) {
+	const char *names[MAX_LEVELS] = { "L1", "L2", "LLC" };
+	level_t levels[MAX_LEVELS] = { { 0, 0, 0 } };
+	int c;
+
+	while ( ( c = getopt( argc, argv, "hvm:M:p:" ) ) != -1 ) {
+		switch ( c ) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 'm':
+			min_bytes = strtoull( optarg, NULL, 10 );
+			break;
+		case 'M':
+			max_bytes = strtoull( optarg, NULL, 10 );
+			break;
+		case 'p':
+			trials = atoi( optarg );
+			break;
+		default:
+			printUsage( argv );
+		}
+	}
+
+	if ( min_bytes == 0 || max_bytes < min_bytes || trials <= 0 ) {
+		printf( "%s: Sizes and trials must be positive\n", argv[0] );
+		exit( 1 );
+	}
+
+	size_t line = probeLine();
+	if ( line == 0 ) {
+		printf( "No line size found\n" );
+		exit( 1 );
+	}
+	int found = probeCapacity( line, levels );
+	int lower = 0;
+	for ( int i = 0; i < found; i++ ) {
+		levels[i].ways = probeWays( levels[i].size, lower );
+		if ( levels[i].ways ) {
+			lower = levels[i].ways;
+		}
+	}
+
+	printf( "line size: %zu bytes\n", line );
+	printf( "%-5s %10s %6s %10s\n", "level", "size", "ways", "latency" );
+	for ( int i = 0; i < MAX_LEVELS; i++ ) {
+		printf( "%-5s ", names[i] );
+		if ( i >= found ) {
+			printf( "not found below %zu MiB\n", max_bytes >> 20 );
+			continue;
+		}
+		printSize( levels[i].size );
+		if ( levels[i].ways ) {
+			printf( " %6d", levels[i].ways );
+		} else {
+			printf( " %6s", "?" );
+		}
+		printf( " %7.2f ns\n", levels[i].ns );
+	}
+
+	printf( "\ncsim configurations:\n" );
+	for ( int i = 0; i < found; i++ ) {
+		printCsim( names[i], &levels[i], line );
+	}
+	return 0;
+}
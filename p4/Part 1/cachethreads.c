@@ -0,0 +1,290 @@
+////////////////////////////////////////////////////////////////////////
+// Main File:        cachethreads.c
+// This File:        cachethreads.c
+// Other Files:      bench.c, bench.h
+// Semester:         CS 354 Spring 2017
+//
+// Author:           Sean Kim
+// Email:            skim658@wisc.edu
+// CS Login:         seank
+//
+// Multi-threaded versions of the cache1D loop, to see what sharing cache
+// lines between cores costs.  Each thread is pinned to a core and stores
+// into:
+//
+//  - interleaved: every Tth element of one shared array, so all threads
+//    write the same lines (false sharing)
+//  - padded: its own counter in a separate cache line
+//  - disjoint: its own contiguous part of the shared array
+//  - atomic: one counter shared by all threads, with atomic adds
+//
+// Throughput is printed for thread counts doubling up to -t.
+//
+// Build:  gcc -std=gnu99 -O2 -pthread -o cachethreads cachethreads.c bench.c
+//
+////////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define MAX_THREADS 256
+#define LINE 64
+
+// Sharing patterns
+typedef enum {
+	MODE_INTERLEAVED = 0,
+	MODE_PADDED,
+	MODE_DISJOINT,
+	MODE_ATOMIC,
+	NUM_MODES
+} sharing_t;
+
+const char *mode_names[NUM_MODES] = { "interleaved", "padded", "disjoint", "atomic" };
+
+// Globals set by command line args
+size_t elements = 100000; // shared array length, as cache1D's arr
+size_t stores = 1 << 24; // stores per thread
+int max_threads = 0; // 0 = one per allowed CPU
+int cpus[MAX_THREADS]; // CPU of each thread, threads wrap around the list
+int cpu_count = 0;
+int pin = 1;
+int trials = 3; // timed runs per point, the fastest is reported
+
+// Type: One thread's counter, alone in its cache line
+typedef struct padded {
+	volatile long value;
+	char pad[LINE - sizeof( long )];
+} __attribute__( ( aligned( LINE ) ) ) padded_t;
+
+// Type: When one thread started and finished storing and how many stores
+// it made, alone in its line
+typedef struct span {
+	double start;
+	double end;
+	size_t stores;
+} __attribute__( ( aligned( LINE ) ) ) span_t;
+
+// Shared state of a run
+volatile int *arr;
+span_t spans[MAX_THREADS];
+padded_t slots[MAX_THREADS];
+long shared_counter __attribute__( ( aligned( LINE ) ) );
+pthread_barrier_t start_barrier;
+int run_mode;
+int run_threads;
+
+/* worker - store stores times in the pattern of run_mode as thread id.  A
+ * thread with no elements of its own in the array stores nothing.
+ */
+void *worker( void *arg ) {
+	int id = ( long ) arg;
+	int t = run_threads;
+	size_t done = 0;
+
+	pthread_barrier_wait( &start_barrier );
+	spans[id].start = nowNs();
+	switch ( run_mode ) {
+	case MODE_INTERLEAVED:
+		while ( done < stores && ( size_t ) id < elements ) {
+			for ( size_t i = id; i < elements && done < stores; i += t, done++ ) {
+				arr[i] = i;
+			}
+		}
+		break;
+	case MODE_PADDED:
+		for ( ; done < stores; done++ ) {
+			slots[id].value++;
+		}
+		break;
+	case MODE_DISJOINT: {
+		size_t begin = elements * id / t;
+		size_t end = elements * ( id + 1 ) / t;
+		while ( done < stores && end > begin ) {
+			for ( size_t i = begin; i < end && done < stores; i++, done++ ) {
+				arr[i] = i;
+			}
+		}
+		break;
+	}
+	case MODE_ATOMIC:
+		for ( ; done < stores; done++ ) {
+			__atomic_fetch_add( &shared_counter, 1, __ATOMIC_RELAXED );
+		}
+		break;
+	}
+	spans[id].end = nowNs();
+	spans[id].stores = done;
+	return NULL;
+}
+
+/* runThreads - time threads workers in mode, in ns from the first one
+ * starting to store until the last one finishes, and count the stores they
+ * made into made.  The threads time themselves, as they may run before this
+ * thread returns from the barrier.  Exits if a thread cannot be started.
+ */
+double runThreads( int mode, int threads, size_t *made ) {
+	pthread_t pool[MAX_THREADS];
+	run_mode = mode;
+	run_threads = threads;
+	pthread_barrier_init( &start_barrier, NULL, threads + 1 );
+
+	for ( int i = 0; i < threads; i++ ) {
+		pthread_attr_t attr;
+		pthread_attr_init( &attr );
+		if ( pin ) {
+			cpu_set_t set;
+			CPU_ZERO( &set );
+			CPU_SET( cpus[i % cpu_count], &set );
+			pthread_attr_setaffinity_np( &attr, sizeof( set ), &set );
+		}
+		if ( pthread_create( &pool[i], &attr, worker, ( void * ) ( long ) i ) != 0 ) {
+			fprintf( stderr, "Cannot create thread %d\n", i );
+			exit( 1 );
+		}
+		pthread_attr_destroy( &attr );
+	}
+
+	pthread_barrier_wait( &start_barrier );
+	double start = 0, end = 0;
+	*made = 0;
+	for ( int i = 0; i < threads; i++ ) {
+		pthread_join( pool[i], NULL );
+		*made += spans[i].stores;
+		if ( i == 0 || spans[i].start < start ) {
+			start = spans[i].start;
+		}
+		if ( spans[i].end > end ) {
+			end = spans[i].end;
+		}
+	}
+	pthread_barrier_destroy( &start_barrier );
+	return end - start;
+}
+
+/* parseCpus - read a comma separated CPU list into cpus */
+void parseCpus( char *list ) {
+	cpu_count = 0;
+	for ( char *tok = strtok( list, "," ); tok != NULL && cpu_count < MAX_THREADS;
+			tok = strtok( NULL, "," ) ) {
+		cpus[cpu_count++] = atoi( tok );
+	}
+}
+
+/* allowedCpus - fill cpus with the CPUs this process may run on */
+void allowedCpus() {
+	cpu_set_t set;
+	cpu_count = 0;
+	if ( sched_getaffinity( 0, sizeof( set ), &set ) == 0 ) {
+		for ( int i = 0; i < CPU_SETSIZE && cpu_count < MAX_THREADS; i++ ) {
+			if ( CPU_ISSET( i, &set ) ) {
+				cpus[cpu_count++] = i;
+			}
+		}
+	}
+	if ( cpu_count == 0 ) {
+		cpus[cpu_count++] = 0;
+	}
+}
+
+/* printUsage - print usage info */
+void printUsage( char *argv[] ) {
+	printf( "Usage: %s [-hu] [-t <num>] [-c <cpus>] [-n <num>] [-N <num>] [-p <num>]\n", argv[0] );
+	printf( "Options:\n" );
+	printf( "  -h         Print this help message.\n" );
+	printf( "  -t <num>   Most threads, counts double up to it (default one per CPU).\n" );
+	printf( "  -c <cpus>  Comma separated CPUs to pin thread 0, 1, ... to (default all).\n" );
+	printf( "  -u         Do not pin threads.\n" );
+	printf( "  -n <num>   Elements of the shared array (default 100000).\n" );
+	printf( "  -N <num>   Stores per thread (default 16777216).\n" );
+	printf( "  -p <num>   Timed runs per point, the fastest is reported (default 3).\n" );
+	printf( "\nExamples:\n" );
+	printf( "  linux>  %s -t 8 -c 0,2,4,6,8,10,12,14\n", argv[0] );
+	exit( 0 );
+}
+
+int main( int argc, char *argv[] ) {
+	int c;
+
+	allowedCpus();
+	while ( ( c = getopt( argc, argv, "ht:c:un:N:p:" ) ) != -1 ) {
+		switch ( c ) {
+		case 't':
+			max_threads = atoi( optarg );
+			break;
+		case 'c':
+			parseCpus( optarg );
+			break;
+		case 'u':
+			pin = 0;
+			break;
+		case 'n':
+			elements = strtoull( optarg, NULL, 10 );
+			break;
+		case 'N':
+			stores = strtoull( optarg, NULL, 10 );
+			break;
+		case 'p':
+			trials = atoi( optarg );
+			break;
+		default:
+			printUsage( argv );
+		}
+	}
+
+	if ( max_threads == 0 ) {
+		max_threads = cpu_count;
+	}
+	if ( max_threads <= 0 || max_threads > MAX_THREADS || cpu_count == 0 ||
+			elements == 0 || stores == 0 || trials <= 0 ) {
+		printf( "%s: Threads must be 1 to %d, sizes and trials positive\n",
+			argv[0], MAX_THREADS );
+		exit( 1 );
+	}
+
+	arr = allocArray( elements * sizeof( int ) );
+	memset( ( void * ) arr, 0, elements * sizeof( int ) );
+
+	if ( pin ) {
+		printf( "cpus:" );
+		for ( int i = 0; i < max_threads && i < cpu_count; i++ ) {
+			printf( "%s%d", i ? "," : "", cpus[i] );
+		}
+		printf( "\n" );
+	}
+	printf( "%-12s %8s %14s %14s %8s\n", "mode", "threads", "Mstores/s", "per thread", "scaling" );
+	for ( int mode = 0; mode < NUM_MODES; mode++ ) {
+		double single = 0;
+		for ( int threads = 1; ; threads = threads * 2 > max_threads &&
+				threads < max_threads ? max_threads : threads * 2 ) {
+			double best = 0;
+			size_t made = 0;
+			for ( int t = 0; t < trials; t++ ) {
+				double ns = runThreads( mode, threads, &made );
+				if ( best == 0 || ns < best ) {
+					best = ns;
+				}
+			}
+			double rate = made / best * 1e3;
+			if ( threads == 1 ) {
+				single = rate;
+			}
+			printf( "%-12s %8d %14.1f %14.1f %7.2fx\n", mode_names[mode], threads,
+				rate, rate / threads, rate / single );
+			fflush( stdout );
+			if ( threads >= max_threads ) {
+				break;
+			}
+		}
+	}
+
+	free( ( void * ) arr );
+	return 0;
+}
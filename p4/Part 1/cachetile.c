@@ -0,0 +1,325 @@
+////////////////////////////////////////////////////////////////////////
+// Main File:        cachetile.c
+// This File:        cachetile.c
+// Other Files:      bench.c, bench.h
+// Semester:         CS 354 Spring 2017
+//
+// Author:           Sean Kim
+// Email:            skim658@wisc.edu
+// CS Login:         seank
+//
+// How much loop tiling recovers over cache2Dcols' column walk.  The array
+// is filled column-first naively, tile by tile and by cache-oblivious
+// recursive splitting, and transposed out of place and in place, naively
+// and blocked.  Every kernel is checked once, then timed, and printed with
+// its speedup over the naive walk it replaces.
+//
+// Build:  gcc -std=gnu99 -O2 -o cachetile cachetile.c bench.c -lm
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "bench.h"
+
+// Globals set by command line args
+size_t rows = 3000; // array dimensions, as arr2Dcols
+size_t cols = 500;
+size_t tile = 32; // tile edge in elements
+int trials = 5; // timed runs per kernel, the fastest is reported
+size_t min_stores = 1 << 24; // small arrays are rerun to at least this many stores
+
+// A kernel works on an r x c array a, and for out-of-place transposes
+// writes the c x r array b
+typedef void ( *kernel_fn )( int *a, int *b, size_t r, size_t c );
+
+static inline size_t minSize( size_t x, size_t y ) {
+	return x < y ? x : y;
+}
+
+/* fillRows - cache2Drows' loop */
+void fillRows( int *a, int *b, size_t r, size_t c ) {
+	for ( size_t i = 0; i < r; i++ ) {
+		for ( size_t k = 0; k < c; k++ ) {
+			a[i * c + k] = i + k;
+		}
+	}
+}
+
+/* fillCols - cache2Dcols' loop */
+void fillCols( int *a, int *b, size_t r, size_t c ) {
+	for ( size_t i = 0; i < c; i++ ) {
+		for ( size_t j = 0; j < r; j++ ) {
+			a[j * c + i] = i + j;
+		}
+	}
+}
+
+/* fillColsTiled - the column walk within each tile x tile block, so a
+ * block's lines stay cached until all its columns are done
+ */
+void fillColsTiled( int *a, int *b, size_t r, size_t c ) {
+	for ( size_t jj = 0; jj < r; jj += tile ) {
+		for ( size_t ii = 0; ii < c; ii += tile ) {
+			size_t jend = minSize( jj + tile, r );
+			size_t iend = minSize( ii + tile, c );
+			for ( size_t i = ii; i < iend; i++ ) {
+				for ( size_t j = jj; j < jend; j++ ) {
+					a[j * c + i] = i + j;
+				}
+			}
+		}
+	}
+}
+
+/* fillObliviousRange - column walk of rows [r0, r1) x cols [c0, c1) of an
+ * array with c columns, halving the longer side until the block is at most
+ * tile x tile.  The halving fits some level of the recursion to every cache
+ * without knowing its size; tile only bounds the recursion overhead.
+ */
+void fillObliviousRange( int *a, size_t c, size_t r0, size_t r1, size_t c0, size_t c1 ) {
+	if ( ( r1 - r0 ) * ( c1 - c0 ) <= tile * tile ) {
+		for ( size_t i = c0; i < c1; i++ ) {
+			for ( size_t j = r0; j < r1; j++ ) {
+				a[j * c + i] = i + j;
+			}
+		}
+	} else if ( r1 - r0 >= c1 - c0 ) {
+		size_t mid = r0 + ( r1 - r0 ) / 2;
+		fillObliviousRange( a, c, r0, mid, c0, c1 );
+		fillObliviousRange( a, c, mid, r1, c0, c1 );
+	} else {
+		size_t mid = c0 + ( c1 - c0 ) / 2;
+		fillObliviousRange( a, c, r0, r1, c0, mid );
+		fillObliviousRange( a, c, r0, r1, mid, c1 );
+	}
+}
+
+/* fillOblivious - cache-oblivious recursive column walk */
+void fillOblivious( int *a, int *b, size_t r, size_t c ) {
+	fillObliviousRange( a, c, 0, r, 0, c );
+}
+
+/* transposeNaive - b = a transposed, reading a by rows */
+void transposeNaive( int *a, int *b, size_t r, size_t c ) {
+	for ( size_t i = 0; i < r; i++ ) {
+		for ( size_t j = 0; j < c; j++ ) {
+			b[j * r + i] = a[i * c + j];
+		}
+	}
+}
+
+/* transposeTiled - b = a transposed one tile x tile block at a time */
+void transposeTiled( int *a, int *b, size_t r, size_t c ) {
+	for ( size_t ii = 0; ii < r; ii += tile ) {
+		for ( size_t jj = 0; jj < c; jj += tile ) {
+			size_t iend = minSize( ii + tile, r );
+			size_t jend = minSize( jj + tile, c );
+			for ( size_t i = ii; i < iend; i++ ) {
+				for ( size_t j = jj; j < jend; j++ ) {
+					b[j * r + i] = a[i * c + j];
+				}
+			}
+		}
+	}
+}
+
+/* transposeObliviousRange - transpose rows [r0, r1) x cols [c0, c1) of the
+ * r x c array a into b, halving the longer side as fillObliviousRange does
+ */
+void transposeObliviousRange( int *a, int *b, size_t r, size_t c,
+		size_t r0, size_t r1, size_t c0, size_t c1 ) {
+	if ( ( r1 - r0 ) * ( c1 - c0 ) <= tile * tile ) {
+		for ( size_t i = r0; i < r1; i++ ) {
+			for ( size_t j = c0; j < c1; j++ ) {
+				b[j * r + i] = a[i * c + j];
+			}
+		}
+	} else if ( r1 - r0 >= c1 - c0 ) {
+		size_t mid = r0 + ( r1 - r0 ) / 2;
+		transposeObliviousRange( a, b, r, c, r0, mid, c0, c1 );
+		transposeObliviousRange( a, b, r, c, mid, r1, c0, c1 );
+	} else {
+		size_t mid = c0 + ( c1 - c0 ) / 2;
+		transposeObliviousRange( a, b, r, c, r0, r1, c0, mid );
+		transposeObliviousRange( a, b, r, c, r0, r1, mid, c1 );
+	}
+}
+
+/* transposeOblivious - cache-oblivious out-of-place transpose */
+void transposeOblivious( int *a, int *b, size_t r, size_t c ) {
+	transposeObliviousRange( a, b, r, c, 0, r, 0, c );
+}
+
+/* transposeInPlaceNaive - transpose the square n x n array a in place by
+ * swapping across the diagonal (r == c == n)
+ */
+void transposeInPlaceNaive( int *a, int *b, size_t n, size_t c ) {
+	for ( size_t i = 0; i < n; i++ ) {
+		for ( size_t j = i + 1; j < n; j++ ) {
+			int tmp = a[i * n + j];
+			a[i * n + j] = a[j * n + i];
+			a[j * n + i] = tmp;
+		}
+	}
+}
+
+/* transposeInPlaceTiled - in-place transpose swapping each tile above the
+ * diagonal with its mirror below it, element by element
+ */
+void transposeInPlaceTiled( int *a, int *b, size_t n, size_t c ) {
+	for ( size_t ii = 0; ii < n; ii += tile ) {
+		for ( size_t jj = ii; jj < n; jj += tile ) {
+			size_t iend = minSize( ii + tile, n );
+			size_t jend = minSize( jj + tile, n );
+			for ( size_t i = ii; i < iend; i++ ) {
+				for ( size_t j = jj == ii ? i + 1 : jj; j < jend; j++ ) {
+					int tmp = a[i * n + j];
+					a[i * n + j] = a[j * n + i];
+					a[j * n + i] = tmp;
+				}
+			}
+		}
+	}
+}
+
+// Type: A benchmarked kernel and the naive kernel it is compared with
+typedef struct variant {
+	const char *name;
+	kernel_fn kernel;
+	int baseline; // index of the naive variant
+	int square; // works on the n x n array
+	int transpose; // checked as a transpose rather than a fill
+} variant_t;
+
+variant_t variants[] = {
+	{ "cols", fillCols, 0, 0, 0 },
+	{ "rows", fillRows, 0, 0, 0 },
+	{ "cols-tiled", fillColsTiled, 0, 0, 0 },
+	{ "cols-oblivious", fillOblivious, 0, 0, 0 },
+	{ "transpose", transposeNaive, 4, 0, 1 },
+	{ "transpose-tiled", transposeTiled, 4, 0, 1 },
+	{ "transpose-oblivious", transposeOblivious, 4, 0, 1 },
+	{ "inplace", transposeInPlaceNaive, 7, 1, 1 },
+	{ "inplace-tiled", transposeInPlaceTiled, 7, 1, 1 },
+};
+
+#define NUM_VARIANTS ( sizeof( variants ) / sizeof( variants[0] ) )
+
+/* initSource - a[i][j] = i * c + j, so every element is distinct */
+void initSource( int *a, size_t r, size_t c ) {
+	for ( size_t i = 0; i < r * c; i++ ) {
+		a[i] = i;
+	}
+}
+
+/* check - run v once on a fresh r x c array and verify the result.
+ * Returns 1 if it is correct.
+ */
+int check( variant_t *v, int *a, int *b, size_t r, size_t c ) {
+	initSource( a, r, c );
+	v->kernel( a, b, r, c );
+	int *out = v->square ? a : b;
+	for ( size_t i = 0; i < r; i++ ) {
+		for ( size_t j = 0; j < c; j++ ) {
+			int expect = v->transpose ? ( int ) ( i * c + j ) : ( int ) ( i + j );
+			int got = v->transpose ? out[j * r + i] : a[i * c + j];
+			if ( got != expect ) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/* measure - fastest of trials runs of v over an r x c array, in ns */
+double measure( variant_t *v, int *a, int *b, size_t r, size_t c ) {
+	size_t n = r * c;
+	size_t reps = n < min_stores ? min_stores / n : 1;
+	double best = 0;
+
+	for ( int t = 0; t < trials; t++ ) {
+		double start = nowNs();
+		for ( size_t i = 0; i < reps; i++ ) {
+			v->kernel( a, b, r, c );
+		}
+		double ns = ( nowNs() - start ) / reps;
+		if ( best == 0 || ns < best ) {
+			best = ns;
+		}
+	}
+	return best;
+}
+
+/* printUsage - print usage info */
+void printUsage( char *argv[] ) {
+	printf( "Usage: %s [-h] [-r <num>] [-c <num>] [-T <num>] [-p <num>]\n", argv[0] );
+	printf( "Options:\n" );
+	printf( "  -h         Print this help message.\n" );
+	printf( "  -r <num>   Rows of the array (default 3000).\n" );
+	printf( "  -c <num>   Columns of the array (default 500).\n" );
+	printf( "  -T <num>   Tile edge in elements (default 32).\n" );
+	printf( "  -p <num>   Timed trials per kernel, the fastest is reported (default 5).\n" );
+	printf( "\nThe in-place transposes use the square array with as many elements.\n" );
+	printf( "\nExamples:\n" );
+	printf( "  linux>  %s -r 3000 -c 500 -T 16\n", argv[0] );
+	exit( 0 );
+}
+
+int main( int argc, char *argv[] ) {
+	int c;
+
+	while ( ( c = getopt( argc, argv, "hr:c:T:p:" ) ) != -1 ) {
+		switch ( c ) {
+		case 'r':
+			rows = strtoull( optarg, NULL, 10 );
+			break;
+		case 'c':
+			cols = strtoull( optarg, NULL, 10 );
+			break;
+		case 'T':
+			tile = strtoull( optarg, NULL, 10 );
+			break;
+		case 'p':
+			trials = atoi( optarg );
+			break;
+		default:
+			printUsage( argv );
+		}
+	}
+
+	if ( rows == 0 || cols == 0 || tile == 0 || trials <= 0 ) {
+		printf( "%s: Sizes, tile and trials must be positive\n", argv[0] );
+		exit( 1 );
+	}
+
+	size_t side = sqrt( ( double ) rows * cols );
+	int *a = allocArray( rows * cols * sizeof( int ) );
+	int *b = allocArray( rows * cols * sizeof( int ) );
+	double ns[NUM_VARIANTS];
+
+	printf( "array:%zux%zu square:%zux%zu tile:%zu\n", rows, cols, side, side, tile );
+	printf( "%-20s %10s %12s %10s\n", "kernel", "ns/elem", "bytes/cycle", "speedup" );
+	for ( size_t i = 0; i < NUM_VARIANTS; i++ ) {
+		variant_t *v = &variants[i];
+		size_t r = v->square ? side : rows;
+		size_t cl = v->square ? side : cols;
+		if ( !check( v, a, b, r, cl ) ) {
+			printf( "%s: wrong result\n", v->name );
+			exit( 1 );
+		}
+		ns[i] = measure( v, a, b, r, cl );
+		// a transpose reads and writes every element, a fill only writes
+		size_t bytes = r * cl * sizeof( int ) * ( v->transpose ? 2 : 1 );
+		printf( "%-20s %10.3f %12.3f %9.2fx\n", v->name, ns[i] / ( r * cl ),
+			bytes / ( ns[i] * tscPerNs() ), ns[v->baseline] / ns[i] );
+		fflush( stdout );
+	}
+
+	free( a );
+	free( b );
+	return 0;
+}
@@ -4,7 +4,11 @@
  *
  * csim.c - A cache simulator that can replay traces from Valgrind
  *     and output statistics such as number of hits, misses, and
- *     evictions.  The replacement policy is LRU.
+ *     evictions.  The replacement policy is LRU unless -r selects FIFO or
+ *     random replacement.
+ *
+ * Traces are Valgrind text or the binary format of trace.h (as written by
+ * tracegen), detected from the file's magic.
  *
  * Implementation and assumptions:
  *  1. Each load/store can cause at most one cache miss.
@@ -13,349 +17,2876 @@
  *  address. Hence, an M operation can result in two cache hits, or a miss and a
  *  hit plus an possible eviction.
  *
+ * Analysis mode (-a):
+ *  Every miss is classified as compulsory (first access to the block),
+ *  capacity (also misses in a fully associative LRU cache of the same size)
+ *  or conflict (hits in that shadow cache).  Misses and evictions are
+ *  aggregated per block and per set to report the hottest lines and the most
+ *  conflicted sets.
+ *
+ * Windowed statistics (-w):
+ *  Every N accesses the hits, misses, evictions, miss rate and working set
+ *  (distinct blocks touched) of the window are written as CSV or JSON, to
+ *  show phase behaviour that the end-of-run totals average away.
+ *
+ * TLB mode (-p):
+ *  The same address stream also drives an L1/L2 TLB hierarchy per page size
+ *  (4k, 2m and/or 1g), reporting hit rates per level and page walks, so the
+ *  payoff of huge pages can be read off one run.
+ *
+ * Sweep mode (-G):
+ *  -s, -E, -b and -r take lists ("1,2,4" or ranges "1-8").  The trace is
+ *  decoded into memory once and a pool of threads simulates every point of the
+ *  grid over that shared read-only buffer, writing one CSV result table.
+ *
+ * Tag lookup:
+ *  The simulated cache keeps each set's tags and LRU stamps in packed
+ *  arrays, so sets with many lines (large E, or fully associative with s = 0)
+ *  are searched and reduced to their LRU line with SSE4.2 or AVX2 compares,
+ *  picked at startup from what the CPU supports (-K forces a kernel).  Sets
+ *  under 16 lines stay scalar, and AVX2 is used from 64 lines, SSE4.2 below.
+ *
+ * Set indexing and victim cache (-H, -S, -V):
+ *  Sets can be indexed by the plain block address bits (default), by XOR
+ *  folding the whole block address, or skewed with a different hash per way;
+ *  -S allows set counts that are not a power of 2.  -V adds a small fully
+ *  associative victim cache that holds lines evicted from the main cache.
+ *  Plain-indexed caches without (and, with both options, with hashing but
+ *  without) a victim cache run alongside to report how many conflict misses
+ *  each option removes.
+ *
+ * Checkpoints (-C, -l):
+ *  The full cache state (tags, LRU/FIFO stamps, clock, random state and
+ *  counters) can be saved after a given number of accesses and loaded at
+ *  startup, so a warm-up prefix is simulated once and reused for many trace
+ *  segments.  A run from a checkpoint counts only its own accesses.  With
+ *  -a, -H or -V the 3C shadow cache and the blocks touched so far are saved
+ *  too, so resumed runs classify misses as the uninterrupted run would.
+ *
+ * Set sampling (-F):
+ *  Only a fraction of the sets, picked by a hash of the set index, is
+ *  simulated; accesses to the other sets are dropped before the lookup.  The
+ *  totals are scaled by all accesses over sampled accesses and the miss rate
+ *  gets a 95% confidence interval from the spread between sampled sets.
+ *
+ * Reuse distances (-d):
+ *  For every access the number of distinct blocks touched since the previous
+ *  access to the same block is found with a Fenwick tree over last-access
+ *  times, and a log2-bucketed histogram is printed.  An LRU cache of C blocks
+ *  hits exactly the accesses with distance below C.
+ *
+ * Timing (-m):
+ *  The trace is decoded into memory first and then simulated, and the time
+ *  of each phase and the simulated accesses per second go to stderr.
+ *
+ * Multi-core mode (more than one -t, or -P):
+ *  Each trace is replayed on its own core with a private cache of the same
+ *  geometry.  The caches are kept coherent with MESI or MOESI, and the
+ *  simulator counts invalidations, cache-to-cache transfers, writebacks and
+ *  lines that bounce between cores, flagging likely false sharing.
+ *
  * The function printSummary() is given to print output.
  * Please use this function to print the number of hits, misses and evictions.
- * This is crucial for the driver to evaluate your work. 
+ * This is crucial for the driver to evaluate your work.
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "trace.h"
+
+/****************************************************************************/
+/***** DO NOT MODIFY THESE VARIABLE NAMES ***********************************/
+
+/* Globals set by command line args */
+int verbosity = 0; /* print trace if set */
+int s = 0; /* set index bits */
+int b = 0; /* block offset bits */
+int E = 0; /* associativity */
+char* trace_file = NULL;
+
+/* Derived from command line args */
+int S; /* number of sets S = 2^s In C, you can use the left shift operator */
+int B; /* block size (bytes) B = 2^b */
+
+/* Counters used to record cache statistics */
+unsigned long long miss_count = 0;
+unsigned long long hit_count = 0;
+unsigned long long eviction_count = 0;
+/*****************************************************************************/
+
+/* Replacement policies */
+typedef enum {
+    POLICY_LRU = 0,
+    POLICY_FIFO,
+    POLICY_RANDOM,
+    NUM_POLICIES
+} policy_t;
+
+const char* policy_names[NUM_POLICIES] = { "lru", "fifo", "random" };
+
+/* Replacement policy set by command line args */
+int policy = POLICY_LRU;
+
+/* Maximum number of cores (one trace each) in multi-core mode */
+#define MAX_CORES 64
+
+/* Multi-core globals set by command line args */
+char* core_traces[MAX_CORES]; /* one trace file per core */
+int num_cores = 0; /* number of -t arguments given */
+int coherence = 0; /* simulate coherent per-core caches if set */
+int moesi = 0; /* use MOESI instead of MESI if set */
+int interleave_ts = 0; /* interleave by timestamp instead of round-robin */
+int top_n = 10; /* number of entries in the hot-line reports */
+
+/* Set index functions */
+typedef enum {
+    INDEX_PLAIN = 0,
+    INDEX_XOR,
+    INDEX_SKEW,
+    NUM_INDEXES
+} index_mode_t;
+
+const char* index_names[NUM_INDEXES] = { "plain", "xor", "skew" };
+
+/* Indexing and victim cache globals set by command line args */
+int index_mode = INDEX_PLAIN;
+int sets_override = 0; /* number of sets if not 2^s */
+int victim_entries = 0; /* lines in the victim cache, 0 disables it */
+
+/* Checkpoint globals set by command line args */
+char* checkpoint_file = NULL; /* save the cache state to this file */
+unsigned long long checkpoint_at = 0; /* ... after this many accesses, 0 = at the end */
+char* restore_file = NULL; /* start from the cache state in this file */
+
+/* Fraction of sets simulated, 0 simulates all of them */
+double sample_fraction = 0;
+
+/* Compute the reuse-distance histogram if set */
+int reuse = 0;
+
+/* Measure the parse and simulate phases separately if set */
+int measure = 0;
+
+/* Sweep globals set by command line args */
+#define MAX_GRID 64
+int sweep = 0; /* run a design-space sweep if set */
+int sweep_threads = 0; /* worker threads, 0 means one per online CPU */
+char* s_list = NULL; /* -s, -E, -b and -r as given, parsed as lists */
+char* E_list = NULL;
+char* b_list = NULL;
+char* r_list = NULL;
+
+/* Analysis globals set by command line args */
+int analyze = 0; /* classify misses and report hot lines and sets if set */
+
+/* Windowed statistics globals set by command line args */
+unsigned long long window_size = 0; /* accesses per window, 0 disables windows */
+int window_json = 0; /* emit windows as JSON instead of CSV */
+char* window_file = NULL; /* window output file, stdout if not given */
+
+/* TLB globals set by command line args */
+#define MAX_TLBS 3
+int tlb_count = 0; /* number of page sizes simulated, 0 disables the TLB */
+int tlb_page_bits[MAX_TLBS]; /* log2 of each simulated page size */
+int tlb_levels = 2; /* TLB levels (1 or 2) */
+int tlb_entries[2] = { 64, 1536 }; /* entries per level */
+int tlb_ways[2] = { 4, 12 }; /* associativity per level */
+
+
+/* Type: Memory address
+ * Use this type whenever dealing with addresses or address masks
+ */
+typedef unsigned long long int mem_addr_t;
+
+/* Coherence state of a line in multi-core mode.  Invalid lines have
+ * valid == 0, so the single-cache path never has to look at this.
+ */
+typedef enum {
+    STATE_I = 0,
+    STATE_S,
+    STATE_E,
+    STATE_O,
+    STATE_M
+} coherence_state_t;
+
+/* Type: Cache line
+ * valid/tag identify the block held in the line, counter is the value of
+ * lru_clock at the last access (smallest counter in a set is the LRU line).
+ * state and touched are only used in multi-core mode: touched has one bit per
+ * 1/64th of the block and records which bytes the owning core accessed since
+ * the line was filled, so invalidations can be classified as false sharing.
+ */
+typedef struct cache_line {
+    char valid;
+    char state;
+    mem_addr_t tag;
+    struct cache_line * next;
+    unsigned long long counter;
+    unsigned long long touched;
+} cache_line_t;
+
+typedef cache_line_t* cache_set_t;
+typedef cache_set_t* cache_t;
+
+
+/* Tag of a free line in packed storage; real tags are at most 63 bits */
+#define INVALID_TAG (~0ULL)
+
+/* Type: Packed cache storage
+ * Line i of set k lives at index k * ways + i of both arrays.  Free lines hold
+ * INVALID_TAG and stamp 0, so the line with the smallest stamp is a free one
+ * if there is any, otherwise the LRU (or, for FIFO, the oldest) line.
+ */
+typedef struct packed_cache {
+    mem_addr_t *tags;
+    unsigned long long *stamps;
+    size_t sets;
+    int ways;
+} packed_cache_t;
+
+/* Type: A simulated cache
+ * lines is indexed according to mode; victim is a single fully associative
+ * LRU set (ways == 0 without a victim cache).  clock and rng are the
+ * replacement state, the counters are used by the comparison caches.
+ */
+typedef struct cache_model {
+    packed_cache_t lines;
+    packed_cache_t victim;
+    int mode;
+    unsigned long long clock;
+    unsigned long long rng;
+    unsigned long long victim_hits;
+    unsigned long long misses;
+    unsigned long long conflicts;
+} cache_model_t;
+
+/* The cache we are simulating */
+cache_model_t cache;
+
+/* Caches that run alongside it to measure the conflict misses that indexing
+ * and the victim cache remove: plain indexing without a victim cache, then
+ * the chosen indexing without a victim cache
+ */
+cache_model_t compare_models[2];
+int compare_count = 0;
+
+/* Sets with at least SIMD_MIN_WAYS lines use the vector lookup kernels, the
+ * AVX2 ones only from WIDE_MIN_WAYS: below these scalar and then SSE4.2 are
+ * faster (measured on random and linear traces, 2 million accesses)
+ */
+#define SIMD_MIN_WAYS 16
+#define WIDE_MIN_WAYS 64
+
+/* Lookup kernels, chosen at startup by selectKernels(); the narrow ones are
+ * used for sets of SIMD_MIN_WAYS up to WIDE_MIN_WAYS lines
+ */
+int (*findTag)(const mem_addr_t* tags, int ways, mem_addr_t tag);
+int (*findOldest)(const unsigned long long* stamps, int ways);
+int (*findTagNarrow)(const mem_addr_t* tags, int ways, mem_addr_t tag);
+int (*findOldestNarrow)(const unsigned long long* stamps, int ways);
+const char* kernel_name = NULL; /* -K kernel, best available if not given */
+
+/* Logical time used for LRU by the per-core caches and TLBs */
+unsigned long long lru_clock = 0;
+
+/* Initial state of the generators used for random replacement */
+#define RNG_SEED 0x2545F4914F6CDD1DULL
+
+/* Type: One decoded trace record
+ * op is 'L', 'S' or 'M'; ts is the leading timestamp of timestamped traces,
+ * or the record number in binary traces.
+ */
+typedef struct trace_rec {
+    char op;
+    mem_addr_t addr;
+    unsigned int len;
+    unsigned long long ts;
+} trace_rec_t;
+
+/* Type: An open trace file, text or binary */
+typedef struct trace_reader {
+    FILE* fp;
+    int binary;
+    int timestamped;
+    unsigned long long records; /* binary records read so far */
+    unsigned long long lines; /* text lines read so far */
+    char* name;
+} trace_reader_t;
+
+/* Per-core statistics in multi-core mode */
+typedef struct core_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    unsigned long long invalidations; /* copies of this core invalidated by others */
+    unsigned long long transfers; /* misses served by another core's cache */
+    unsigned long long writebacks; /* dirty lines written back to memory */
+    unsigned long long upgrades; /* stores that hit a shared/owned line */
+} core_stats_t;
+
+/* Per-core caches and statistics in multi-core mode */
+cache_t core_cache[MAX_CORES];
+core_stats_t core_stats[MAX_CORES];
+
+/* Type: Statistics kept for one block address
+ * Entries live in an open-addressing hash table keyed by block (addr >> b).
+ */
+typedef struct block_stat {
+    char used;
+    mem_addr_t block;
+    int last_writer; /* core that last wrote the block, -1 if none */
+    unsigned long long bounces; /* ownership moves between writing cores */
+    unsigned long long invalidations;
+    unsigned long long false_sharing; /* invalidations of disjoint bytes */
+    unsigned long long transfers;
+    unsigned long long accesses;
+    unsigned long long misses;
+    unsigned long long evictions;
+    char warm; /* touched before a restored checkpoint */
+    size_t shadow; /* node + 1 in the shadow cache, 0 if not resident */
+    unsigned long long window; /* last window (+ 1) the block was touched in */
+    size_t last_access; /* Fenwick position of the last access, 0 if none */
+} block_stat_t;
+
+typedef struct block_table {
+    block_stat_t *slots;
+    size_t cap; /* always a power of 2 */
+    size_t used;
+} block_table_t;
+
+/* Per-block statistics gathered in multi-core and analysis mode */
+block_table_t blocks;
+
+/* Type: Per-set statistics in analysis mode */
+typedef struct set_stat {
+    unsigned long long misses;
+    unsigned long long evictions;
+    unsigned long long conflicts;
+} set_stat_t;
+
+/* Type: Shadow fully associative LRU cache used to classify misses
+ * nodes[0] is the sentinel of a doubly linked list ordered from most to least
+ * recently used; nodes[1..cap] hold the resident blocks.
+ */
+typedef struct shadow_node {
+    mem_addr_t block;
+    size_t prev;
+    size_t next;
+} shadow_node_t;
+
+typedef struct shadow_cache {
+    shadow_node_t *nodes;
+    size_t cap;
+    size_t count;
+} shadow_cache_t;
+
+/* Analysis mode state */
+set_stat_t *set_stats;
+shadow_cache_t shadow;
+unsigned long long compulsory_count = 0;
+unsigned long long capacity_count = 0;
+unsigned long long conflict_count = 0;
+
+/* Type: One TLB level
+ * A set-associative LRU cache of virtual page numbers; the line tag holds the
+ * full page number and the set is page number modulo sets.
+ */
+typedef struct tlb_level {
+    int sets;
+    int ways;
+    cache_t entries;
+    unsigned long long hits;
+    unsigned long long misses;
+} tlb_level_t;
+
+/* Type: TLB hierarchy for one page size */
+typedef struct tlb {
+    int page_bits;
+    tlb_level_t level[2];
+    unsigned long long walks;
+} tlb_t;
+
+/* TLB mode state */
+tlb_t tlbs[MAX_TLBS];
+
+/* Type: Checkpoint file header, followed by the S * E tags and the S * E
+ * stamps of the cache, then the tags and stamps of the victim cache, then
+ * for each of the compare_count comparison caches its tags, stamps, clock
+ * and rng, then with analysis the shadow_lines blocks of the shadow cache
+ * from least to most recently used and the touched blocks
+ */
+#define CHECKPOINT_MAGIC "CSIMCKP2"
+typedef struct checkpoint {
+    char magic[8];
+    int s;
+    int E;
+    int b;
+    int policy;
+    int sets;
+    int index_mode;
+    int victim_entries;
+    int compare_count;
+    int analysis; /* 1 if the 3C shadow cache and touched blocks follow */
+    unsigned long long accesses; /* accesses simulated before the checkpoint */
+    unsigned long long clock;
+    unsigned long long rng;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    unsigned long long shadow_lines;
+    unsigned long long touched;
+} checkpoint_t;
+
+/* Accesses simulated so far, including those before a restored checkpoint */
+unsigned long long access_count = 0;
+
+/* Set-sampling state */
+unsigned char* sampled_sets; /* 1 for the sets that are simulated */
+int sampled_count = 0;
+unsigned long long* set_accesses; /* accesses and misses per sampled set */
+unsigned long long* set_misses;
+unsigned long long total_accesses = 0;
+unsigned long long sampled_accesses = 0;
+
+/* Reuse-distance state: one mark in the Fenwick tree at the last access of
+ * every block, so the marks after a block's last access count the distinct
+ * blocks touched since.  Buckets: 0 for distance 0, k for [2^(k-1), 2^k).
+ */
+#define REUSE_BUCKETS 66
+long long* fenwick;
+size_t fenwick_cap = 0;
+size_t reuse_time = 0; /* last Fenwick position used */
+unsigned long long reuse_cold = 0; /* first accesses (infinite distance) */
+unsigned long long reuse_hist[REUSE_BUCKETS];
+
+/* Windowed statistics state */
+FILE* window_fp;
+unsigned long long window_index = 0; /* number of windows emitted so far */
+unsigned long long window_accesses = 0; /* accesses in the current window */
+unsigned long long window_blocks = 0; /* distinct blocks in the current window */
+unsigned long long window_hits = 0; /* counters at the start of the window */
+unsigned long long window_misses = 0;
+unsigned long long window_evictions = 0;
+
+void printUsage(char* argv[], int status);
+
+/* plainIndex - block modulo sets, a mask when sets is a power of 2 */
+static inline size_t plainIndex(mem_addr_t block, size_t sets)
+{
+	return ( sets & ( sets - 1 ) ) == 0 ? block & ( sets - 1 ) : block % sets;
+}
+
+/* xorIndex - XOR of all index-sized chunks of the block address, so high
+ * address bits also pick the set and power-of-2 strides spread out
+ */
+static inline size_t xorIndex(mem_addr_t block, size_t sets)
+{
+	int bits = sets > 1 ? 64 - __builtin_clzll( sets - 1 ) : 1;
+	mem_addr_t mask = ( 1ULL << bits ) - 1;
+	mem_addr_t folded = 0;
+	for ( ; block; block >>= bits ) {
+		folded ^= block & mask;
+	}
+	return plainIndex( folded, sets );
+}
+
+/* skewIndex - set of block in way of a skewed-associative cache, a
+ * different hash per way
+ */
+static inline size_t skewIndex(mem_addr_t block, int way, size_t sets)
+{
+	unsigned long long h = ( block + way * 0x632BE59BD9B4E019ULL ) * 0x9E3779B97F4A7C15ULL;
+	h ^= h >> 31;
+	return h % sets;
+}
+
+/* modelIndex - set of block under index mode (way 0's set when skewed) */
+static inline size_t modelIndex(int mode, mem_addr_t block, size_t sets)
+{
+	switch ( mode ) {
+	case INDEX_XOR:
+		return xorIndex( block, sets );
+	case INDEX_SKEW:
+		return skewIndex( block, 0, sets );
+	default:
+		return plainIndex( block, sets );
+	}
+}
+
+/* setIndex/tagOf - set index and tag of an address.  Tags hold the whole
+ * block address, so they stay unique whatever the index function.
+ */
+static inline mem_addr_t setIndex(mem_addr_t addr)
+{
+	return modelIndex( index_mode, addr >> b, S );
+}
+
+static inline mem_addr_t tagOf(mem_addr_t addr)
+{
+	return addr >> b;
+}
+
+/* allocCache - allocate S sets of E zeroed lines each, as used for the
+ * per-core caches of multi-core mode
+ */
+cache_t allocCache()
+{
+	cache_t c = malloc( sizeof( cache_set_t ) * S );
+	if ( c == NULL ) {
+		fprintf( stderr, "Cannot allocate cache\n" );
+		exit( 1 );
+	}
+	for ( int i = 0; i < S; i++ ) {
+		c[i] = calloc( E, sizeof( cache_line_t ) );
+		if ( c[i] == NULL ) {
+			fprintf( stderr, "Cannot allocate cache\n" );
+			exit( 1 );
+		}
+	}
+	return c;
+}
+
+/* releaseCache - free a cache returned by allocCache */
+void releaseCache(cache_t c)
+{
+	for ( int i = 0; i < S; i++ ) {
+		free( c[i] );
+	}
+	free( c );
+}
+
+/* nextRandom - xorshift64 step of the generator in *state */
+static inline unsigned long long nextRandom(unsigned long long* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+/* allocPacked - allocate packed storage for sets * ways free lines, 32-byte
+ * aligned for the vector kernels
+ */
+void allocPacked(packed_cache_t* c, size_t sets, int ways)
+{
+	size_t bytes = ( sets * ways * sizeof( mem_addr_t ) + 31 ) & ~(size_t) 31;
+	c->sets = sets;
+	c->ways = ways;
+	if ( posix_memalign( (void**) &c->tags, 32, bytes ) != 0 ||
+			posix_memalign( (void**) &c->stamps, 32, bytes ) != 0 ) {
+		fprintf( stderr, "Cannot allocate cache\n" );
+		exit( 1 );
+	}
+	memset( c->tags, 0xff, bytes );
+	memset( c->stamps, 0, bytes );
+}
+
+/* freePacked - free storage allocated by allocPacked */
+void freePacked(packed_cache_t* c)
+{
+	free( c->tags );
+	free( c->stamps );
+}
+
+/* initModel - allocate an empty cache of S sets of E lines with the given
+ * index mode and victim cache size
+ */
+void initModel(cache_model_t* m, int mode, int victims)
+{
+	memset( m, 0, sizeof( *m ) );
+	allocPacked( &m->lines, S, E );
+	if ( victims ) {
+		allocPacked( &m->victim, 1, victims );
+	}
+	m->mode = mode;
+	m->rng = RNG_SEED;
+}
+
+/* freeModel - free a cache allocated by initModel */
+void freeModel(cache_model_t* m)
+{
+	freePacked( &m->lines );
+	if ( m->victim.ways ) {
+		freePacked( &m->victim );
+	}
+}
+
+/* TODO - COMPLETE THIS FUNCTION
+ * initCache -
+ * Allocate data structures to hold info regrading the sets and cache lines
+ * Initialize valid and tag field with 0s.
+ * use S (= 2^s) and E while allocating the data structures here
+ */
+void initCache()
+{
+	// set big S and big B using little s and little b, unless the number of
+	// sets was given directly
+	S = sets_override ? sets_override : pow( 2, s );
+	B = pow( 2, b );
+
+	// allocate the tags and stamps of every set, every line starts out free
+	initModel( &cache, index_mode, victim_entries );
+
+	// plain-indexed caches without a victim cache to compare against
+	if ( index_mode != INDEX_PLAIN || victim_entries ) {
+		initModel( &compare_models[compare_count++], INDEX_PLAIN, 0 );
+	}
+	if ( index_mode != INDEX_PLAIN && victim_entries ) {
+		initModel( &compare_models[compare_count++], index_mode, 0 );
+	}
+}
+
+
+/* TODO - COMPLETE THIS FUNCTION
+ * freeCache - free each piece of memory you allocated using malloc
+ * inside initCache() function
+ */
+void freeCache()
+{
+	freeModel( &cache );
+	for ( int i = 0; i < compare_count; i++ ) {
+		freeModel( &compare_models[i] );
+	}
+}
+
+/* findTagScalar/findOldestScalar - portable lookup kernels: the line of a
+ * packed set holding tag (or -1), and the line with the smallest stamp
+ */
+int findTagScalar(const mem_addr_t* tags, int ways, mem_addr_t tag)
+{
+	for ( int i = 0; i < ways; i++ ) {
+		if ( tags[i] == tag ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int findOldestScalar(const unsigned long long* stamps, int ways)
+{
+	int oldest = 0;
+	for ( int i = 1; i < ways; i++ ) {
+		if ( stamps[i] < stamps[oldest] ) {
+			oldest = i;
+		}
+	}
+	return oldest;
+}
+
+#if defined(__x86_64__)
+/* findTagSse/findOldestSse - SSE4.2 kernels, two lines per compare.  Stamps
+ * stay below 2^63, so signed 64-bit compares order them correctly.
+ */
+__attribute__((target("sse4.2")))
+int findTagSse(const mem_addr_t* tags, int ways, mem_addr_t tag)
+{
+	__m128i key = _mm_set1_epi64x( tag );
+	int i = 0;
+	for ( ; i + 2 <= ways; i += 2 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i*) ( tags + i ) );
+		int m = _mm_movemask_pd( _mm_castsi128_pd( _mm_cmpeq_epi64( v, key ) ) );
+		if ( m ) {
+			return i + __builtin_ctz( m );
+		}
+	}
+	return i < ways && tags[i] == tag ? i : -1;
+}
+
+__attribute__((target("sse4.2")))
+int findOldestSse(const unsigned long long* stamps, int ways)
+{
+	__m128i best = _mm_loadu_si128( (const __m128i*) stamps );
+	__m128i bestIdx = _mm_set_epi64x( 1, 0 );
+	__m128i idx = bestIdx;
+	__m128i step = _mm_set1_epi64x( 2 );
+	int i = 2;
+	for ( ; i + 2 <= ways; i += 2 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i*) ( stamps + i ) );
+		idx = _mm_add_epi64( idx, step );
+		__m128i lt = _mm_cmpgt_epi64( best, v );
+		best = _mm_blendv_epi8( best, v, lt );
+		bestIdx = _mm_blendv_epi8( bestIdx, idx, lt );
+	}
+	long long b0 = _mm_cvtsi128_si64( best );
+	long long b1 = _mm_extract_epi64( best, 1 );
+	int oldest = b1 < b0 ? _mm_extract_epi64( bestIdx, 1 ) : _mm_cvtsi128_si64( bestIdx );
+	for ( ; i < ways; i++ ) {
+		if ( stamps[i] < stamps[oldest] ) {
+			oldest = i;
+		}
+	}
+	return oldest;
+}
+
+/* findTagAvx2/findOldestAvx2 - AVX2 kernels, four lines per compare */
+__attribute__((target("avx2")))
+int findTagAvx2(const mem_addr_t* tags, int ways, mem_addr_t tag)
+{
+	__m256i key = _mm256_set1_epi64x( tag );
+	int i = 0;
+	for ( ; i + 4 <= ways; i += 4 ) {
+		__m256i v = _mm256_loadu_si256( (const __m256i*) ( tags + i ) );
+		int m = _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpeq_epi64( v, key ) ) );
+		if ( m ) {
+			return i + __builtin_ctz( m );
+		}
+	}
+	for ( ; i < ways; i++ ) {
+		if ( tags[i] == tag ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+__attribute__((target("avx2")))
+int findOldestAvx2(const unsigned long long* stamps, int ways)
+{
+	__m256i best = _mm256_loadu_si256( (const __m256i*) stamps );
+	__m256i bestIdx = _mm256_set_epi64x( 3, 2, 1, 0 );
+	__m256i idx = bestIdx;
+	__m256i step = _mm256_set1_epi64x( 4 );
+	int i = 4;
+	for ( ; i + 4 <= ways; i += 4 ) {
+		__m256i v = _mm256_loadu_si256( (const __m256i*) ( stamps + i ) );
+		idx = _mm256_add_epi64( idx, step );
+		__m256i lt = _mm256_cmpgt_epi64( best, v );
+		best = _mm256_blendv_epi8( best, v, lt );
+		bestIdx = _mm256_blendv_epi8( bestIdx, idx, lt );
+	}
+	long long lanes[4], lanesIdx[4];
+	_mm256_storeu_si256( (__m256i*) lanes, best );
+	_mm256_storeu_si256( (__m256i*) lanesIdx, bestIdx );
+	int oldest = lanesIdx[0];
+	for ( int k = 1; k < 4; k++ ) {
+		if ( (unsigned long long) lanes[k] < stamps[oldest] ) {
+			oldest = lanesIdx[k];
+		}
+	}
+	for ( ; i < ways; i++ ) {
+		if ( stamps[i] < stamps[oldest] ) {
+			oldest = i;
+		}
+	}
+	return oldest;
+}
+#endif
+
+/* selectKernels - pick the lookup kernels: the one named by -K, otherwise
+ * the widest the CPU supports, with SSE4.2 for the narrower sets when that
+ * is AVX2.  Returns 0 if the named kernel is unknown or not supported.
+ */
+int selectKernels()
+{
+	findTag = findTagScalar;
+	findOldest = findOldestScalar;
+	findTagNarrow = findTagScalar;
+	findOldestNarrow = findOldestScalar;
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	int avx2 = __builtin_cpu_supports( "avx2" );
+	int sse = __builtin_cpu_supports( "sse4.2" );
+	if ( kernel_name != NULL ) {
+		avx2 = avx2 && strcmp( kernel_name, "avx2" ) == 0;
+		sse = sse && strcmp( kernel_name, "sse4.2" ) == 0;
+	}
+	if ( sse ) {
+		findTag = findTagNarrow = findTagSse;
+		findOldest = findOldestNarrow = findOldestSse;
+		kernel_name = "sse4.2";
+	}
+	if ( avx2 ) {
+		findTag = findTagAvx2;
+		findOldest = findOldestAvx2;
+		if ( !sse ) {
+			findTagNarrow = findTagAvx2;
+			findOldestNarrow = findOldestAvx2;
+		}
+		kernel_name = sse ? "avx2+sse4.2" : "avx2";
+	}
+	if ( sse || avx2 ) {
+		return 1;
+	}
+#endif
+	if ( kernel_name != NULL && strcmp( kernel_name, "scalar" ) != 0 ) {
+		return 0;
+	}
+	kernel_name = "scalar";
+	return 1;
+}
+
+/* packedAccess - look up tag in set of packed cache c and fill it on a miss.
+ * clock and rng are the caller's LRU clock and random state.  Returns 1 on a
+ * hit; on a miss *evicted is the replaced tag, or INVALID_TAG if a free line
+ * was filled.
+ */
+static inline int packedAccess(packed_cache_t* c, size_t set, mem_addr_t tag,
+		int pol, unsigned long long* clock, unsigned long long* rng,
+		mem_addr_t* evicted)
+{
+	int ways = c->ways;
+	mem_addr_t* tags = c->tags + set * ways;
+	unsigned long long* stamps = c->stamps + set * ways;
+	int simd = ways >= SIMD_MIN_WAYS;
+	int wide = ways >= WIDE_MIN_WAYS;
+
+	int line = !simd ? findTagScalar( tags, ways, tag ) :
+		wide ? findTag( tags, ways, tag ) : findTagNarrow( tags, ways, tag );
+	if ( line >= 0 ) {
+		if ( pol == POLICY_LRU ) {
+			stamps[line] = ++*clock;
+		}
+		return 1;
+	}
+
+	line = !simd ? findOldestScalar( stamps, ways ) :
+		wide ? findOldest( stamps, ways ) : findOldestNarrow( stamps, ways );
+	if ( stamps[line] != 0 && pol == POLICY_RANDOM ) {
+		line = nextRandom( rng ) % ways;
+	}
+	*evicted = tags[line];
+	tags[line] = tag;
+	stamps[line] = ++*clock;
+	return 0;
+}
+
+/* skewAccess - packedAccess for a skewed-associative cache: way w of block
+ * is line w of set skewIndex(block, w), and the victim is the LRU line among
+ * those candidates
+ */
+static inline int skewAccess(cache_model_t* m, mem_addr_t block, mem_addr_t* evicted)
+{
+	int ways = m->lines.ways;
+	size_t victim = 0;
+	for ( int w = 0; w < ways; w++ ) {
+		size_t at = skewIndex( block, w, m->lines.sets ) * ways + w;
+		if ( m->lines.tags[at] == block ) {
+			if ( policy == POLICY_LRU ) {
+				m->lines.stamps[at] = ++m->clock;
+			}
+			return 1;
+		}
+		if ( w == 0 || m->lines.stamps[at] < m->lines.stamps[victim] ) {
+			victim = at;
+		}
+	}
+	if ( m->lines.stamps[victim] != 0 && policy == POLICY_RANDOM ) {
+		int w = nextRandom( &m->rng ) % ways;
+		victim = skewIndex( block, w, m->lines.sets ) * ways + w;
+	}
+	*evicted = m->lines.tags[victim];
+	m->lines.tags[victim] = block;
+	m->lines.stamps[victim] = ++m->clock;
+	return 0;
+}
+
+/* modelAccess - access block in cache m.  Returns 1 on a hit in the main
+ * cache, 2 on a hit in the victim cache (the lines are swapped) and 0 on a
+ * miss, with *evicted the block that left the cache or INVALID_TAG.
+ */
+int modelAccess(cache_model_t* m, mem_addr_t block, mem_addr_t* evicted)
+{
+	mem_addr_t out = INVALID_TAG;
+	int hit;
+
+	if ( m->mode == INDEX_SKEW ) {
+		hit = skewAccess( m, block, &out );
+	} else {
+		hit = packedAccess( &m->lines, modelIndex( m->mode, block, m->lines.sets ),
+			block, policy, &m->clock, &m->rng, &out );
+	}
+	*evicted = INVALID_TAG;
+	if ( hit ) {
+		return 1;
+	}
+	if ( m->victim.ways == 0 ) {
+		*evicted = out;
+		return 0;
+	}
+
+	// the block was filled into the main cache above; if the victim cache
+	// had it, the line it displaced takes its place there
+	int v = findTagScalar( m->victim.tags, m->victim.ways, block );
+	if ( v >= 0 ) {
+		m->victim.tags[v] = out;
+		m->victim.stamps[v] = out == INVALID_TAG ? 0 : ++m->clock;
+		m->victim_hits++;
+		return 2;
+	}
+
+	// otherwise the displaced line moves to the victim cache, pushing out its
+	// least recently used line
+	if ( out != INVALID_TAG ) {
+		packedAccess( &m->victim, 0, out, POLICY_LRU, &m->clock, &m->rng, evicted );
+	}
+	return 0;
+}
+
+/* lookupBlock - return the statistics entry of block in table, inserting a
+ * zeroed entry if it is not there yet.  Inserting may move the entries, so
+ * pointers returned earlier are only stable while no new block is added.
+ */
+block_stat_t* lookupBlock(block_table_t* table, mem_addr_t block)
+{
+	size_t mask = table->cap - 1;
+	size_t i = ( block * 0x9E3779B97F4A7C15ULL ) >> 20 & mask;
+	while ( table->cap && table->slots[i].used ) {
+		if ( table->slots[i].block == block ) {
+			return &table->slots[i];
+		}
+		i = ( i + 1 ) & mask;
+	}
+
+	// grow the table once it is 70% full and insert into the new one
+	if ( ( table->used + 1 ) * 10 > table->cap * 7 ) {
+		block_table_t bigger;
+		bigger.cap = table->cap ? table->cap * 2 : 1024;
+		bigger.used = 0;
+		bigger.slots = calloc( bigger.cap, sizeof( block_stat_t ) );
+		if ( bigger.slots == NULL ) {
+			fprintf( stderr, "Cannot allocate block table\n" );
+			exit( 1 );
+		}
+		for ( size_t k = 0; k < table->cap; k++ ) {
+			if ( table->slots[k].used ) {
+				*lookupBlock( &bigger, table->slots[k].block ) = table->slots[k];
+			}
+		}
+		free( table->slots );
+		*table = bigger;
+		return lookupBlock( table, block );
+	}
+
+	table->used++;
+	table->slots[i].used = 1;
+	table->slots[i].block = block;
+	table->slots[i].last_writer = -1;
+	return &table->slots[i];
+}
+
+/* freeBlocks - free the memory of a block table */
+void freeBlocks(block_table_t* table)
+{
+	free( table->slots );
+	table->slots = NULL;
+	table->cap = 0;
+	table->used = 0;
+}
+
+/* findLine - return the index of the valid line of set holding tag,
+ * or -1 if the block is not cached
+ */
+int findLine(cache_set_t set, int lines, mem_addr_t tag)
+{
+	for ( int i = 0; i < lines; i++ ) {
+		if ( set[i].valid && set[i].tag == tag ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* findVictim - return the line of set to fill on a miss: a free line if
+ * there is one, otherwise the least recently used line
+ */
+int findVictim(cache_set_t set, int lines)
+{
+	int victim = 0;
+	for ( int i = 0; i < lines; i++ ) {
+		if ( !set[i].valid ) {
+			return i;
+		}
+		if ( set[i].counter < set[victim].counter ) {
+			victim = i;
+		}
+	}
+	return victim;
+}
+
+/* shadowUnlink/shadowPushFront - list operations of the shadow cache */
+static inline void shadowUnlink(size_t n)
+{
+	shadow.nodes[shadow.nodes[n].prev].next = shadow.nodes[n].next;
+	shadow.nodes[shadow.nodes[n].next].prev = shadow.nodes[n].prev;
+}
+
+static inline void shadowPushFront(size_t n)
+{
+	shadow.nodes[n].prev = 0;
+	shadow.nodes[n].next = shadow.nodes[0].next;
+	shadow.nodes[shadow.nodes[0].next].prev = n;
+	shadow.nodes[0].next = n;
+}
+
+/* shadowAccess - access blk in the shadow fully associative cache of S * E
+ * lines, returns 1 on a hit.  May look up the evicted block in blocks, which
+ * never inserts, so blk stays valid.
+ */
+int shadowAccess(block_stat_t* blk)
+{
+	size_t n = blk->shadow;
+	if ( n ) {
+		shadowUnlink( n );
+		shadowPushFront( n );
+		return 1;
+	}
+	if ( shadow.count < shadow.cap ) {
+		n = ++shadow.count;
+	} else {
+		// reuse the least recently used node
+		n = shadow.nodes[0].prev;
+		shadowUnlink( n );
+		lookupBlock( &blocks, shadow.nodes[n].block )->shadow = 0;
+	}
+	shadow.nodes[n].block = blk->block;
+	shadowPushFront( n );
+	blk->shadow = n;
+	return 0;
+}
+
+/* initAnalysis - allocate the per-set statistics and the shadow cache */
+void initAnalysis()
+{
+	set_stats = calloc( S, sizeof( set_stat_t ) );
+	shadow.cap = (size_t) S * E;
+	shadow.count = 0;
+	shadow.nodes = calloc( shadow.cap + 1, sizeof( shadow_node_t ) );
+	if ( set_stats == NULL || shadow.nodes == NULL ) {
+		fprintf( stderr, "Cannot allocate analysis state\n" );
+		exit( 1 );
+	}
+}
+
+/* freeAnalysis - free the memory allocated by initAnalysis */
+void freeAnalysis()
+{
+	free( set_stats );
+	free( shadow.nodes );
+}
+
+/* Miss classes */
+#define MISS_COMPULSORY 0
+#define MISS_CAPACITY 1
+#define MISS_CONFLICT 2
+
+/* classifyAccess - update the analysis statistics for one access to addr.
+ * hit tells whether the simulated cache hit; on an eviction, evicted is the
+ * block address that was replaced.  Returns the class a miss on this access
+ * has, whether or not the simulated cache missed.
+ */
+int classifyAccess(mem_addr_t addr, int hit, int evicted, mem_addr_t evictedBlock)
+{
+	mem_addr_t setBits = setIndex( addr );
+	block_stat_t* blk = lookupBlock( &blocks, addr >> b );
+	int compulsory = blk->accesses++ == 0 && !blk->warm;
+	int shadowHit = shadowAccess( blk );
+
+	if ( !hit ) {
+		blk->misses++;
+		set_stats[setBits].misses++;
+		if ( compulsory ) {
+			compulsory_count++;
+		} else if ( !shadowHit ) {
+			capacity_count++;
+		} else {
+			conflict_count++;
+			set_stats[setBits].conflicts++;
+		}
+	}
+	if ( evicted ) {
+		lookupBlock( &blocks, evictedBlock )->evictions++;
+		set_stats[setBits].evictions++;
+	}
+	return compulsory ? MISS_COMPULSORY : shadowHit ? MISS_CONFLICT : MISS_CAPACITY;
+}
+
+/* TODO - COMPLETE THIS FUNCTION
+ * accessData - Access data at memory address addr.
+ *   If it is already in cache, increase hit_count
+ *   If it is not in cache, bring it in cache, increase miss count.
+ *   Also increase eviction_count if a line is evicted.
+ *   you will manipulate data structures allocated in initCache() here
+ */
+void accessData(mem_addr_t addr)
+{
+	// isolate the set and tag bits in the address
+	mem_addr_t setBits = setIndex( addr );
+	mem_addr_t evicted = INVALID_TAG;
+
+	// with set sampling, accesses to sets outside the sample are skipped
+	if ( sample_fraction ) {
+		total_accesses++;
+		if ( !sampled_sets[setBits] ) {
+			return;
+		}
+		sampled_accesses++;
+		set_accesses[setBits]++;
+	}
+
+	// on a hit the line's stamp is refreshed, on a miss a free line is filled
+	// or one is evicted according to the replacement policy
+	mem_addr_t block = tagOf( addr );
+	int hit = modelAccess( &cache, block, &evicted );
+	if ( hit ) {
+		hit_count++;
+	} else {
+		miss_count++;
+		if ( sample_fraction ) {
+			set_misses[setBits]++;
+		}
+		if ( evicted != INVALID_TAG ) {
+			eviction_count++;
+		}
+	}
+	if ( analyze || compare_count ) {
+		int cls = classifyAccess( addr, hit, evicted != INVALID_TAG, evicted );
+		for ( int i = 0; i < compare_count; i++ ) {
+			cache_model_t* m = &compare_models[i];
+			mem_addr_t ignored;
+			if ( !modelAccess( m, block, &ignored ) ) {
+				m->misses++;
+				m->conflicts += cls == MISS_CONFLICT;
+			}
+		}
+	}
+}
+
+/* printComparison - print the misses and conflict misses of the comparison
+ * caches and the simulated cache, and how many each step removed
+ */
+void printComparison()
+{
+	unsigned long long prev = 0;
+	char name[64];
+	for ( int i = 0; i <= compare_count; i++ ) {
+		cache_model_t* m = i < compare_count ? &compare_models[i] : &cache;
+		unsigned long long misses = i < compare_count ? m->misses : miss_count;
+		unsigned long long conflicts = i < compare_count ? m->conflicts : conflict_count;
+		snprintf( name, sizeof( name ), "%s%s", index_names[m->mode],
+			m->victim.ways ? "+victim" : "" );
+		printf( "%s: misses:%llu conflict:%llu", name, misses, conflicts );
+		if ( i > 0 ) {
+			printf( " removed:%lld", (long long) ( prev - conflicts ) );
+		}
+		if ( m->victim.ways ) {
+			printf( " victim_hits:%llu", m->victim_hits );
+		}
+		printf( "\n" );
+		prev = conflicts;
+	}
+}
+
+/* initSampling - pick the sampled sets: those whose hashed index falls
+ * below sample_fraction of the hash range, at least one
+ */
+void initSampling()
+{
+	sampled_sets = calloc( S, 1 );
+	set_accesses = calloc( S, sizeof( unsigned long long ) );
+	set_misses = calloc( S, sizeof( unsigned long long ) );
+	if ( sampled_sets == NULL || set_accesses == NULL || set_misses == NULL ) {
+		fprintf( stderr, "Cannot allocate sampling state\n" );
+		exit( 1 );
+	}
+	unsigned long long limit = sample_fraction * 4294967296.0;
+	for ( int i = 0; i < S; i++ ) {
+		unsigned long long h = ( i + 1 ) * 0x9E3779B97F4A7C15ULL;
+		h = ( h ^ ( h >> 29 ) ) * 0xBF58476D1CE4E5B9ULL;
+		sampled_sets[i] = ( h >> 32 ) < limit;
+		sampled_count += sampled_sets[i];
+	}
+	if ( sampled_count == 0 ) {
+		sampled_sets[0] = 1;
+		sampled_count = 1;
+	}
+}
+
+/* finishSampling - print the sample, the miss-rate confidence interval and
+ * scale the counters up to the whole trace
+ */
+void finishSampling()
+{
+	double rate = sampled_accesses ? (double) miss_count / sampled_accesses : 0.0;
+
+	// ratio estimator over sets as clusters, with finite population correction
+	double spread = 0;
+	double n = sampled_count;
+	for ( int i = 0; i < S; i++ ) {
+		if ( sampled_sets[i] ) {
+			double d = set_misses[i] - rate * set_accesses[i];
+			spread += d * d;
+		}
+	}
+	double half = 0;
+	if ( sampled_count > 1 && sampled_accesses > 0 ) {
+		double mean = sampled_accesses / n;
+		double var = ( 1 - n / S ) * spread / ( n - 1 ) / ( n * mean * mean );
+		half = 1.96 * sqrt( var );
+	}
+	printf( "sampled sets:%d/%d accesses:%llu/%llu miss_rate:%.6f +/- %.6f (95%%)\n",
+		sampled_count, S, sampled_accesses, total_accesses, rate, half );
+
+	double scale = sampled_accesses ? (double) total_accesses / sampled_accesses : 0.0;
+	hit_count = hit_count * scale + 0.5;
+	miss_count = miss_count * scale + 0.5;
+	eviction_count = eviction_count * scale + 0.5;
+
+	free( sampled_sets );
+	free( set_accesses );
+	free( set_misses );
+}
+
+/* initTlbs - allocate one TLB hierarchy per simulated page size */
+void initTlbs()
+{
+	for ( int i = 0; i < tlb_count; i++ ) {
+		tlbs[i].page_bits = tlb_page_bits[i];
+		for ( int l = 0; l < tlb_levels; l++ ) {
+			tlb_level_t* lvl = &tlbs[i].level[l];
+			lvl->ways = tlb_ways[l];
+			lvl->sets = tlb_entries[l] / tlb_ways[l];
+			lvl->entries = malloc( sizeof( cache_set_t ) * lvl->sets );
+			if ( lvl->entries == NULL ) {
+				fprintf( stderr, "Cannot allocate TLB\n" );
+				exit( 1 );
+			}
+			for ( int k = 0; k < lvl->sets; k++ ) {
+				lvl->entries[k] = calloc( lvl->ways, sizeof( cache_line_t ) );
+				if ( lvl->entries[k] == NULL ) {
+					fprintf( stderr, "Cannot allocate TLB\n" );
+					exit( 1 );
+				}
+			}
+		}
+	}
+}
+
+/* freeTlbs - free the memory allocated by initTlbs */
+void freeTlbs()
+{
+	for ( int i = 0; i < tlb_count; i++ ) {
+		for ( int l = 0; l < tlb_levels; l++ ) {
+			for ( int k = 0; k < tlbs[i].level[l].sets; k++ ) {
+				free( tlbs[i].level[l].entries[k] );
+			}
+			free( tlbs[i].level[l].entries );
+		}
+	}
+}
+
+/* tlbLookup - look up page in one TLB level, filling it on a miss.
+ * Returns 1 on a hit.
+ */
+int tlbLookup(tlb_level_t* lvl, mem_addr_t page)
+{
+	cache_set_t set = lvl->entries[ page % lvl->sets ];
+	int line = findLine( set, lvl->ways, page );
+	if ( line >= 0 ) {
+		lvl->hits++;
+		set[line].counter = ++lru_clock;
+		return 1;
+	}
+	lvl->misses++;
+	line = findVictim( set, lvl->ways );
+	set[line].valid = 1;
+	set[line].tag = page;
+	set[line].counter = ++lru_clock;
+	return 0;
+}
+
+/* tlbAccess - translate addr in every simulated TLB hierarchy; a miss in
+ * the last level is a page walk
+ */
+void tlbAccess(mem_addr_t addr)
+{
+	for ( int i = 0; i < tlb_count; i++ ) {
+		mem_addr_t page = addr >> tlbs[i].page_bits;
+		int l = 0;
+		while ( l < tlb_levels && !tlbLookup( &tlbs[i].level[l], page ) ) {
+			l++;
+		}
+		if ( l == tlb_levels ) {
+			tlbs[i].walks++;
+		}
+	}
+}
+
+/* printTlbs - print hit rates per level and page walks per page size */
+void printTlbs()
+{
+	for ( int i = 0; i < tlb_count; i++ ) {
+		int bits = tlbs[i].page_bits;
+		printf( "tlb %llu%c:", 1ULL << ( bits % 10 ), bits >= 30 ? 'g' :
+			bits >= 20 ? 'm' : 'k' );
+		for ( int l = 0; l < tlb_levels; l++ ) {
+			tlb_level_t* lvl = &tlbs[i].level[l];
+			unsigned long long total = lvl->hits + lvl->misses;
+			printf( " l%d hits:%llu misses:%llu hit_rate:%.4f", l + 1,
+				lvl->hits, lvl->misses, total ? (double) lvl->hits / total : 0.0 );
+		}
+		printf( " walks:%llu\n", tlbs[i].walks );
+	}
+}
+
+/* openWindows - open the window output and write the CSV header or the
+ * start of the JSON array
+ */
+void openWindows()
+{
+	window_fp = stdout;
+	if ( window_file != NULL ) {
+		window_fp = fopen( window_file, "w" );
+		if ( !window_fp ) {
+			fprintf( stderr, "%s: %s\n", window_file, strerror( errno ) );
+			exit( 1 );
+		}
+	}
+	if ( window_json ) {
+		fprintf( window_fp, "[" );
+	} else {
+		fprintf( window_fp, "window,start,accesses,hits,misses,evictions,"
+			"miss_rate,working_set_blocks,working_set_bytes\n" );
+	}
+}
+
+/* emitWindow - write the statistics of the current window and start a new one */
+void emitWindow()
+{
+	unsigned long long hits = hit_count - window_hits;
+	unsigned long long misses = miss_count - window_misses;
+	unsigned long long evictions = eviction_count - window_evictions;
+	unsigned long long start = window_index * window_size;
+	double missRate = window_accesses ? (double) misses / window_accesses : 0.0;
+
+	if ( window_json ) {
+		fprintf( window_fp, "%s\n  {\"window\": %llu, \"start\": %llu, "
+			"\"accesses\": %llu, \"hits\": %llu, \"misses\": %llu, "
+			"\"evictions\": %llu, \"miss_rate\": %.6f, "
+			"\"working_set_blocks\": %llu, \"working_set_bytes\": %llu}",
+			window_index ? "," : "", window_index, start, window_accesses,
+			hits, misses, evictions, missRate, window_blocks,
+			window_blocks * B );
+	} else {
+		fprintf( window_fp, "%llu,%llu,%llu,%llu,%llu,%llu,%.6f,%llu,%llu\n",
+			window_index, start, window_accesses, hits, misses, evictions,
+			missRate, window_blocks, window_blocks * B );
+	}
+
+	window_index++;
+	window_accesses = 0;
+	window_blocks = 0;
+	window_hits = hit_count;
+	window_misses = miss_count;
+	window_evictions = eviction_count;
+}
+
+/* windowAccess - account one access to addr to the current window */
+void windowAccess(mem_addr_t addr)
+{
+	block_stat_t* blk = lookupBlock( &blocks, addr >> b );
+	if ( blk->window != window_index + 1 ) {
+		blk->window = window_index + 1;
+		window_blocks++;
+	}
+	if ( ++window_accesses == window_size ) {
+		emitWindow();
+	}
+}
+
+/* closeWindows - emit the last partial window and close the output */
+void closeWindows()
+{
+	if ( window_accesses > 0 ) {
+		emitWindow();
+	}
+	if ( window_json ) {
+		fprintf( window_fp, "\n]\n" );
+	}
+	if ( window_fp != stdout ) {
+		fclose( window_fp );
+	}
+}
+
+/* fenwickAdd/fenwickSum - point update and prefix sum over positions 1..i */
+static inline void fenwickAdd(size_t i, long long delta)
+{
+	for ( ; i <= fenwick_cap; i += i & -i ) {
+		fenwick[i] += delta;
+	}
+}
+
+static inline long long fenwickSum(size_t i)
+{
+	long long sum = 0;
+	for ( ; i > 0; i -= i & -i ) {
+		sum += fenwick[i];
+	}
+	return sum;
+}
+
+/* compareLastAccess - qsort order of blocks by last access */
+int compareLastAccess(const void* x, const void* y)
+{
+	size_t p = ( *(block_stat_t* const*) x )->last_access;
+	size_t q = ( *(block_stat_t* const*) y )->last_access;
+	return p < q ? -1 : p > q;
+}
+
+/* compactReuse - renumber the last accesses of all blocks to 1..D once the
+ * Fenwick tree is full, keeping their order, and rebuild the tree with room
+ * to spare.  Does not insert into blocks, so entry pointers stay valid.
+ */
+void compactReuse()
+{
+	block_stat_t** live = malloc( sizeof( block_stat_t* ) * ( blocks.used + 1 ) );
+	size_t n = 0;
+	for ( size_t i = 0; i < blocks.cap; i++ ) {
+		if ( blocks.slots[i].used && blocks.slots[i].last_access ) {
+			live[n++] = &blocks.slots[i];
+		}
+	}
+	qsort( live, n, sizeof( block_stat_t* ), compareLastAccess );
+	for ( size_t i = 0; i < n; i++ ) {
+		live[i]->last_access = i + 1;
+	}
+	free( live );
+
+	if ( fenwick_cap < 4 * n ) {
+		fenwick_cap = 4 * n;
+	}
+	if ( fenwick_cap < ( 1 << 20 ) ) {
+		fenwick_cap = 1 << 20;
+	}
+	free( fenwick );
+	fenwick = calloc( fenwick_cap + 1, sizeof( long long ) );
+	if ( fenwick == NULL ) {
+		fprintf( stderr, "Cannot allocate reuse-distance tree\n" );
+		exit( 1 );
+	}
+	// linear-time build with a mark at positions 1..n
+	for ( size_t i = 1; i <= n; i++ ) {
+		fenwick[i]++;
+		size_t parent = i + ( i & -i );
+		if ( parent <= fenwick_cap ) {
+			fenwick[parent] += fenwick[i];
+		}
+	}
+	for ( size_t i = n + 1; i <= fenwick_cap; i++ ) {
+		size_t parent = i + ( i & -i );
+		if ( parent <= fenwick_cap ) {
+			fenwick[parent] += fenwick[i];
+		}
+	}
+	reuse_time = n;
+}
+
+/* reuseAccess - record the reuse distance of an access to addr */
+void reuseAccess(mem_addr_t addr)
+{
+	block_stat_t* blk = lookupBlock( &blocks, addr >> b );
+	if ( reuse_time == fenwick_cap ) {
+		compactReuse();
+	}
+	size_t t = ++reuse_time;
+	if ( blk->last_access ) {
+		long long distance = fenwickSum( t - 1 ) - fenwickSum( blk->last_access );
+		int bucket = distance ? 64 - __builtin_clzll( distance ) : 0;
+		reuse_hist[bucket]++;
+		fenwickAdd( blk->last_access, -1 );
+	} else {
+		reuse_cold++;
+	}
+	fenwickAdd( t, 1 );
+	blk->last_access = t;
+}
+
+/* printReuse - print the reuse-distance histogram with the cumulative share
+ * of accesses, i.e. the hit rate of a fully associative LRU cache of that
+ * many blocks
+ */
+void printReuse()
+{
+	unsigned long long total = reuse_cold;
+	for ( int i = 0; i < REUSE_BUCKETS; i++ ) {
+		total += reuse_hist[i];
+	}
+	printf( "reuse distance (blocks of %d bytes):\n", B );
+	unsigned long long below = 0;
+	for ( int i = 0; i < REUSE_BUCKETS; i++ ) {
+		if ( reuse_hist[i] == 0 ) {
+			continue;
+		}
+		below += reuse_hist[i];
+		unsigned long long lo = i ? 1ULL << ( i - 1 ) : 0;
+		unsigned long long hi = i ? ( 1ULL << i ) - 1 : 0;
+		printf( "  %llu-%llu: %llu cumulative:%.4f\n", lo, hi, reuse_hist[i],
+			total ? (double) below / total : 0.0 );
+	}
+	printf( "  cold: %llu\n", reuse_cold );
+	free( fenwick );
+}
+
+/* writeModel - write the lines and victim lines of m to fp, 0 on error */
+int writeModel(FILE* fp, cache_model_t* m)
+{
+	size_t lines = m->lines.sets * m->lines.ways;
+	size_t victims = m->victim.ways;
+	return fwrite( m->lines.tags, sizeof( mem_addr_t ), lines, fp ) == lines &&
+		fwrite( m->lines.stamps, sizeof( unsigned long long ), lines, fp ) == lines &&
+		( victims == 0 ||
+			( fwrite( m->victim.tags, sizeof( mem_addr_t ), victims, fp ) == victims &&
+			fwrite( m->victim.stamps, sizeof( unsigned long long ), victims, fp ) == victims ) );
+}
+
+/* readModel - read what writeModel wrote into m, 0 on error */
+int readModel(FILE* fp, cache_model_t* m)
+{
+	size_t lines = m->lines.sets * m->lines.ways;
+	size_t victims = m->victim.ways;
+	return fread( m->lines.tags, sizeof( mem_addr_t ), lines, fp ) == lines &&
+		fread( m->lines.stamps, sizeof( unsigned long long ), lines, fp ) == lines &&
+		( victims == 0 ||
+			( fread( m->victim.tags, sizeof( mem_addr_t ), victims, fp ) == victims &&
+			fread( m->victim.stamps, sizeof( unsigned long long ), victims, fp ) == victims ) );
+}
+
+/* countTouched - number of blocks the miss classification has seen */
+unsigned long long countTouched()
+{
+	unsigned long long count = 0;
+	for ( size_t i = 0; i < blocks.cap; i++ ) {
+		count += blocks.slots[i].used && ( blocks.slots[i].accesses || blocks.slots[i].warm );
+	}
+	return count;
+}
+
+/* writeAnalysis - write the shadow cache blocks from least to most recently
+ * used, then the touched blocks, 0 on error
+ */
+int writeAnalysis(FILE* fp)
+{
+	for ( size_t n = shadow.nodes[0].prev; n != 0; n = shadow.nodes[n].prev ) {
+		if ( fwrite( &shadow.nodes[n].block, sizeof( mem_addr_t ), 1, fp ) != 1 ) {
+			return 0;
+		}
+	}
+	for ( size_t i = 0; i < blocks.cap; i++ ) {
+		block_stat_t* blk = &blocks.slots[i];
+		if ( blk->used && ( blk->accesses || blk->warm ) &&
+				fwrite( &blk->block, sizeof( mem_addr_t ), 1, fp ) != 1 ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* readAnalysis - refill the shadow cache in the saved order and mark the
+ * touched blocks warm, so they do not count as compulsory misses again,
+ * 0 on error
+ */
+int readAnalysis(FILE* fp, checkpoint_t* ck)
+{
+	mem_addr_t block;
+	if ( ck->shadow_lines > shadow.cap ) {
+		return 0;
+	}
+	for ( unsigned long long i = 0; i < ck->shadow_lines; i++ ) {
+		if ( fread( &block, sizeof( block ), 1, fp ) != 1 ) {
+			return 0;
+		}
+		shadowAccess( lookupBlock( &blocks, block ) );
+	}
+	for ( unsigned long long i = 0; i < ck->touched; i++ ) {
+		if ( fread( &block, sizeof( block ), 1, fp ) != 1 ) {
+			return 0;
+		}
+		lookupBlock( &blocks, block )->warm = 1;
+	}
+	return 1;
+}
+
+/* saveCheckpoint - write the cache state to checkpoint_file, with the
+ * comparison caches and the miss classification state so they resume as
+ * warm as the cache
+ */
+void saveCheckpoint()
+{
+	checkpoint_t ck;
+
+	memset( &ck, 0, sizeof( ck ) );
+	memcpy( ck.magic, CHECKPOINT_MAGIC, sizeof( ck.magic ) );
+	ck.s = s;
+	ck.E = E;
+	ck.b = b;
+	ck.policy = policy;
+	ck.sets = S;
+	ck.index_mode = index_mode;
+	ck.victim_entries = victim_entries;
+	ck.compare_count = compare_count;
+	ck.accesses = access_count;
+	ck.clock = cache.clock;
+	ck.rng = cache.rng;
+	ck.hits = hit_count;
+	ck.misses = miss_count;
+	ck.evictions = eviction_count;
+	ck.analysis = analyze || compare_count;
+	if ( ck.analysis ) {
+		ck.shadow_lines = shadow.count;
+		ck.touched = countTouched();
+	}
+
+	FILE* fp = fopen( checkpoint_file, "w" );
+	if ( !fp ) {
+		fprintf( stderr, "%s: %s\n", checkpoint_file, strerror( errno ) );
+		exit( 1 );
+	}
+	int ok = fwrite( &ck, sizeof( ck ), 1, fp ) == 1 && writeModel( fp, &cache );
+	for ( int i = 0; i < compare_count && ok; i++ ) {
+		cache_model_t* m = &compare_models[i];
+		ok = writeModel( fp, m ) &&
+			fwrite( &m->clock, sizeof( m->clock ), 1, fp ) == 1 &&
+			fwrite( &m->rng, sizeof( m->rng ), 1, fp ) == 1;
+	}
+	if ( ok && ck.analysis ) {
+		ok = writeAnalysis( fp );
+	}
+	if ( !ok || fclose( fp ) != 0 ) {
+		fprintf( stderr, "%s: %s\n", checkpoint_file, strerror( errno ) );
+		exit( 1 );
+	}
+}
+
+/* restoreCheckpoint - load the cache state from restore_file.  The geometry
+ * and policy must match the command line, and classifying misses needs a
+ * checkpoint saved with analysis.  Counters restart from zero, the warm-up's
+ * own counters are printed.
+ */
+void restoreCheckpoint()
+{
+	checkpoint_t ck;
+
+	FILE* fp = fopen( restore_file, "r" );
+	if ( !fp ) {
+		fprintf( stderr, "%s: %s\n", restore_file, strerror( errno ) );
+		exit( 1 );
+	}
+	if ( fread( &ck, sizeof( ck ), 1, fp ) != 1 ||
+			memcmp( ck.magic, CHECKPOINT_MAGIC, sizeof( ck.magic ) ) != 0 ) {
+		fprintf( stderr, "%s: Not a checkpoint file\n", restore_file );
+		exit( 1 );
+	}
+	if ( ck.sets != S || ck.E != E || ck.b != b || ck.policy != policy ||
+			ck.index_mode != index_mode || ck.victim_entries != victim_entries ||
+			ck.compare_count != compare_count ) {
+		fprintf( stderr, "%s: Checkpoint is for -S %d -E %d -b %d -r %s -H %s -V %d\n",
+			restore_file, ck.sets, ck.E, ck.b, policy_names[ck.policy % NUM_POLICIES],
+			index_names[ck.index_mode % NUM_INDEXES], ck.victim_entries );
+		exit( 1 );
+	}
+	if ( ( analyze || compare_count ) && !ck.analysis ) {
+		fprintf( stderr, "%s: Checkpoint has no miss classification state, save it with -a\n",
+			restore_file );
+		exit( 1 );
+	}
+	int ok = readModel( fp, &cache );
+	for ( int i = 0; i < compare_count && ok; i++ ) {
+		cache_model_t* m = &compare_models[i];
+		ok = readModel( fp, m ) &&
+			fread( &m->clock, sizeof( m->clock ), 1, fp ) == 1 &&
+			fread( &m->rng, sizeof( m->rng ), 1, fp ) == 1;
+	}
+	if ( ok && ( analyze || compare_count ) ) {
+		ok = readAnalysis( fp, &ck );
+	}
+	if ( !ok ) {
+		fprintf( stderr, "%s: Truncated checkpoint file\n", restore_file );
+		exit( 1 );
+	}
+	fclose( fp );
+
+	access_count = ck.accesses;
+	cache.clock = ck.clock;
+	cache.rng = ck.rng;
+	printf( "warm start after %llu accesses: hits:%llu misses:%llu evictions:%llu\n",
+		ck.accesses, ck.hits, ck.misses, ck.evictions );
+}
+
+/* simulateAccess - one access to addr in the cache and every enabled model
+ * that follows the same address stream
+ */
+void simulateAccess(mem_addr_t addr)
+{
+	accessData( addr );
+	if ( tlb_count ) {
+		tlbAccess( addr );
+	}
+	if ( reuse ) {
+		reuseAccess( addr );
+	}
+	if ( window_size ) {
+		windowAccess( addr );
+	}
+	if ( ++access_count == checkpoint_at && checkpoint_file != NULL ) {
+		saveCheckpoint();
+	}
+}
+
+/* parseRecord - decode one trace line into rec
+ * Returns 1 for data accesses (L/S/M) and 0 for anything else.  Timestamped
+ * traces carry a decimal timestamp in front of the usual Valgrind record;
+ * a record without one returns -1.
+ */
+int parseRecord(char* buf, trace_rec_t* rec, int timestamped)
+{
+	rec->ts = 0;
+	if ( timestamped ) {
+		char* end;
+		rec->ts = strtoull( buf, &end, 10 );
+		if ( end == buf ) {
+			return strspn( buf, " \t\r\n" ) == strlen( buf ) ? 0 : -1;
+		}
+		buf = end;
+	}
+	if ( buf[1] != 'S' && buf[1] != 'L' && buf[1] != 'M' ) {
+		return 0;
+	}
+	rec->op = buf[1];
+
+	// hand-rolled "%llx,%u": sscanf dominates the run time once sampling
+	// skips most of the simulation
+	const char* p = buf + 3;
+	mem_addr_t addr = 0;
+	unsigned int len = 0;
+	while ( *p == ' ' || *p == '\t' ) {
+		p++;
+	}
+	for ( ;; p++ ) {
+		unsigned int d = *p - '0';
+		if ( d > 9 ) {
+			d = ( *p | 0x20 ) - 'a';
+			if ( d > 5 ) {
+				break;
+			}
+			d += 10;
+		}
+		addr = addr << 4 | d;
+	}
+	if ( *p == ',' ) {
+		for ( p++; *p >= '0' && *p <= '9'; p++ ) {
+			len = len * 10 + ( *p - '0' );
+		}
+	}
+	rec->addr = addr;
+	rec->len = len;
+	return 1;
+}
+
+/* openTrace - open trace_fn for reading and detect its format, exits if
+ * the file cannot be opened
+ */
+void openTrace(trace_reader_t* tr, char* trace_fn, int timestamped)
+{
+	char magic[TRACE_MAGIC_LEN];
+
+	tr->fp = fopen( trace_fn, "r" );
+	if ( !tr->fp ) {
+		fprintf( stderr, "%s: %s\n", trace_fn, strerror( errno ) );
+		exit( 1 );
+	}
+	// text records never start with the magic's first letter, so one
+	// character of lookahead is enough and pipes work too
+	int first = fgetc( tr->fp );
+	ungetc( first, tr->fp );
+	tr->binary = first == TRACE_MAGIC[0];
+	if ( tr->binary && ( fread( magic, 1, TRACE_MAGIC_LEN, tr->fp ) != TRACE_MAGIC_LEN ||
+			memcmp( magic, TRACE_MAGIC, TRACE_MAGIC_LEN ) != 0 ) ) {
+		fprintf( stderr, "%s: Not a trace file\n", trace_fn );
+		exit( 1 );
+	}
+	tr->timestamped = timestamped;
+	tr->records = 0;
+	tr->lines = 0;
+	tr->name = trace_fn;
+}
+
+/* closeTrace - close a trace opened by openTrace */
+void closeTrace(trace_reader_t* tr)
+{
+	fclose( tr->fp );
+}
+
+/* readRecord - read the next data access of tr into rec, 0 at end of file */
+int readRecord(trace_reader_t* tr, trace_rec_t* rec)
+{
+	if ( tr->binary ) {
+		trace_bin_rec_t bin;
+		if ( fread( &bin, sizeof( bin ), 1, tr->fp ) != 1 ) {
+			return 0;
+		}
+		rec->op = bin.op;
+		rec->addr = bin.addr;
+		rec->len = bin.len;
+		rec->ts = tr->records++;
+		return 1;
+	}
+
+	char buf[1000];
+	while ( fgets( buf, 1000, tr->fp ) != NULL ) {
+		tr->lines++;
+		int parsed = parseRecord( buf, rec, tr->timestamped );
+		if ( parsed < 0 ) {
+			fprintf( stderr, "%s:%llu: Record has no timestamp\n", tr->name, tr->lines );
+			exit( 1 );
+		}
+		if ( parsed ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* TODO - FILL IN THE MISSING CODE
+ * replayTrace - replays the given trace file against the cache
+ * reads the input trace file line by line
+ * extracts the type of each memory access : L/S/M
+ * YOU MUST TRANSLATE one "L" as a load i.e. 1 memory access
+ * YOU MUST TRANSLATE one "S" as a store i.e. 1 memory access
+ * YOU MUST TRANSLATE one "M" as a load followed by a store i.e. 2 memory accesses
+ */
+void replayTrace(char* trace_fn)
+{
+    trace_rec_t rec;
+    trace_reader_t trace;
+
+    openTrace(&trace, trace_fn, 0);
+
+    while( readRecord(&trace, &rec) ) {
+            if(verbosity)
+                printf("%c %llx,%u ", rec.op, rec.addr, rec.len);
+
+	    // if modify instruction, access the data twice
+	    if ( rec.op == 'M' ) {
+	    	simulateAccess( rec.addr );
+	    }
+	    simulateAccess( rec.addr );
+
+            if (verbosity)
+                printf("\n");
+    }
+
+    closeTrace(&trace);
+}
+
+/* touchMask - bits of a line's touched mask covered by [addr, addr + len) */
+unsigned long long touchMask(mem_addr_t addr, unsigned int len)
+{
+	mem_addr_t offset = addr & ( B - 1 );
+	mem_addr_t last = offset + ( len ? len : 1 ) - 1;
+	if ( last >= (mem_addr_t) B ) {
+		last = B - 1;
+	}
+	int lo = offset * 64 / B;
+	int hi = last * 64 / B;
+	unsigned long long mask = hi == 63 ? ~0ULL : ( 1ULL << ( hi + 1 ) ) - 1;
+	return mask & ~( ( 1ULL << lo ) - 1 );
+}
+
+/* noteWriter - record a store by core to blk, counting a bounce whenever the
+ * block was last written by a different core
+ */
+void noteWriter(block_stat_t* blk, int core)
+{
+	if ( blk->last_writer >= 0 && blk->last_writer != core ) {
+		blk->bounces++;
+	}
+	blk->last_writer = core;
+}
+
+/* invalidateOthers - invalidate every other core's copy of the block so core
+ * can write bytes mask of it.  Returns 1 if a dirty or exclusive copy existed,
+ * i.e. the data can be supplied cache-to-cache.
+ */
+int invalidateOthers(int core, mem_addr_t setBits, mem_addr_t tagBits,
+		unsigned long long mask, block_stat_t* blk)
+{
+	int supplied = 0;
+	for ( int c = 0; c < num_cores; c++ ) {
+		if ( c == core ) {
+			continue;
+		}
+		cache_set_t set = core_cache[c][setBits];
+		int line = findLine( set, E, tagBits );
+		if ( line < 0 ) {
+			continue;
+		}
+		if ( set[line].state != STATE_S ) {
+			supplied = 1;
+		}
+		core_stats[c].invalidations++;
+		blk->invalidations++;
+		if ( ( set[line].touched & mask ) == 0 ) {
+			blk->false_sharing++;
+		}
+		set[line].valid = 0;
+		set[line].state = STATE_I;
+	}
+	return supplied;
+}
+
+/* coherentAccess - one load ('L') or store ('S') of len bytes at addr by
+ * core, keeping every core's private cache coherent
  */
+void coherentAccess(int core, char op, mem_addr_t addr, unsigned int len)
+{
+	mem_addr_t setBits = setIndex( addr );
+	mem_addr_t tagBits = tagOf( addr );
+	unsigned long long mask = touchMask( addr, len );
+	cache_set_t set = core_cache[core][setBits];
+	core_stats_t* st = &core_stats[core];
+	block_stat_t* blk = lookupBlock( &blocks, addr >> b );
 
-#include <getopt.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <stdio.h>
-#include <assert.h>
-#include <math.h>
-#include <limits.h>
-#include <string.h>
-#include <errno.h>
-#include <stdbool.h>
+	int line = findLine( set, E, tagBits );
+	if ( line >= 0 ) {
+		st->hits++;
+		set[line].counter = ++lru_clock;
+		set[line].touched |= mask;
+		if ( op == 'S' ) {
+			// shared and owned copies must invalidate the others first,
+			// an exclusive copy is upgraded silently
+			if ( set[line].state == STATE_S || set[line].state == STATE_O ) {
+				invalidateOthers( core, setBits, tagBits, mask, blk );
+				st->upgrades++;
+			}
+			set[line].state = STATE_M;
+			noteWriter( blk, core );
+		}
+		return;
+	}
 
-/****************************************************************************/
-/***** DO NOT MODIFY THESE VARIABLE NAMES ***********************************/
+	st->misses++;
+	line = findVictim( set, E );
+	if ( set[line].valid ) {
+		st->evictions++;
+		if ( set[line].state == STATE_M || set[line].state == STATE_O ) {
+			st->writebacks++;
+		}
+	}
 
-/* Globals set by command line args */
-int verbosity = 0; /* print trace if set */
-int s = 0; /* set index bits */
-int b = 0; /* block offset bits */
-int E = 0; /* associativity */
-char* trace_file = NULL;
+	char state;
+	if ( op == 'L' ) {
+		// snoop the other cores: any copy makes ours shared, and a dirty or
+		// exclusive copy supplies the data
+		int sharers = 0;
+		int supplied = 0;
+		for ( int c = 0; c < num_cores; c++ ) {
+			if ( c == core ) {
+				continue;
+			}
+			cache_set_t other = core_cache[c][setBits];
+			int l = findLine( other, E, tagBits );
+			if ( l < 0 ) {
+				continue;
+			}
+			sharers = 1;
+			switch ( other[l].state ) {
+			case STATE_M:
+				supplied = 1;
+				if ( moesi ) {
+					other[l].state = STATE_O;
+				} else {
+					core_stats[c].writebacks++;
+					other[l].state = STATE_S;
+				}
+				break;
+			case STATE_O:
+				supplied = 1;
+				break;
+			case STATE_E:
+				supplied = 1;
+				other[l].state = STATE_S;
+				break;
+			default:
+				break;
+			}
+		}
+		if ( supplied ) {
+			st->transfers++;
+			blk->transfers++;
+		}
+		state = sharers ? STATE_S : STATE_E;
+	} else {
+		// read-for-ownership
+		if ( invalidateOthers( core, setBits, tagBits, mask, blk ) ) {
+			st->transfers++;
+			blk->transfers++;
+		}
+		noteWriter( blk, core );
+		state = STATE_M;
+	}
 
-/* Derived from command line args */
-int S; /* number of sets S = 2^s In C, you can use the left shift operator */
-int B; /* block size (bytes) B = 2^b */
+	set[line].valid = 1;
+	set[line].state = state;
+	set[line].tag = tagBits;
+	set[line].counter = ++lru_clock;
+	set[line].touched = mask;
+}
 
-/* Counters used to record cache statistics */
-int miss_count = 0;
-int hit_count = 0;
-int eviction_count = 0;
-/*****************************************************************************/
+/* compareBounces - qsort order for the contended-lines report */
+int compareBounces(const void* x, const void* y)
+{
+	const block_stat_t* p = *(const block_stat_t* const*) x;
+	const block_stat_t* q = *(const block_stat_t* const*) y;
+	if ( p->bounces != q->bounces ) {
+		return p->bounces < q->bounces ? 1 : -1;
+	}
+	if ( p->invalidations != q->invalidations ) {
+		return p->invalidations < q->invalidations ? 1 : -1;
+	}
+	return p->block < q->block ? -1 : p->block > q->block;
+}
 
+/* printCoherence - print per-core statistics and the most contended lines */
+void printCoherence()
+{
+	core_stats_t total = { 0 };
+	for ( int c = 0; c < num_cores; c++ ) {
+		core_stats_t* st = &core_stats[c];
+		printf( "core %d: hits:%llu misses:%llu evictions:%llu invalidations:%llu "
+			"transfers:%llu writebacks:%llu upgrades:%llu\n", c, st->hits,
+			st->misses, st->evictions, st->invalidations, st->transfers,
+			st->writebacks, st->upgrades );
+		total.hits += st->hits;
+		total.misses += st->misses;
+		total.evictions += st->evictions;
+		total.invalidations += st->invalidations;
+		total.transfers += st->transfers;
+		total.writebacks += st->writebacks;
+		total.upgrades += st->upgrades;
+	}
 
-/* Type: Memory address 
- * Use this type whenever dealing with addresses or address masks
- */
-typedef unsigned long long int mem_addr_t;
+	printf( "invalidations:%llu transfers:%llu writebacks:%llu upgrades:%llu\n",
+		total.invalidations, total.transfers, total.writebacks, total.upgrades );
 
-/* Type: Cache line
- * TODO 
- * 
- * NOTE: 
- * You might (not necessarily though) want to add an extra field to this struct
- * depending on your implementation
- * 
- * For example, to use a linked list based LRU,
- * you might want to have a field "struct cache_line * next" in the struct 
- */
-typedef struct cache_line {
-    char valid;
-    mem_addr_t tag;
-    struct cache_line * next;
-    int counter;
-} cache_line_t;
+	// collect the lines that were invalidated or moved between cores
+	block_stat_t** hot = malloc( sizeof( block_stat_t* ) * ( blocks.used + 1 ) );
+	size_t count = 0;
+	size_t bouncing = 0;
+	size_t falselyShared = 0;
+	for ( size_t i = 0; i < blocks.cap; i++ ) {
+		block_stat_t* blk = &blocks.slots[i];
+		if ( !blk->used || ( blk->bounces == 0 && blk->invalidations == 0 ) ) {
+			continue;
+		}
+		bouncing += blk->bounces > 0;
+		falselyShared += blk->false_sharing * 2 > blk->invalidations;
+		hot[count++] = blk;
+	}
+	printf( "bouncing lines:%zu false-sharing lines:%zu\n", bouncing, falselyShared );
 
-typedef cache_line_t* cache_set_t;
-typedef cache_set_t* cache_t;
+	// most contended lines first, flagging those whose invalidations mostly
+	// hit bytes the invalidated core never touched
+	qsort( hot, count, sizeof( block_stat_t* ), compareBounces );
+	for ( size_t i = 0; i < count && i < (size_t) top_n; i++ ) {
+		block_stat_t* blk = hot[i];
+		printf( "  line 0x%llx: bounces:%llu invalidations:%llu false:%llu transfers:%llu%s\n",
+			blk->block << b, blk->bounces, blk->invalidations, blk->false_sharing,
+			blk->transfers, blk->false_sharing * 2 > blk->invalidations ?
+			" FALSE SHARING" : "" );
+	}
+	free( hot );
+}
 
+/* compareMisses - qsort order for the hottest-lines report */
+int compareMisses(const void* x, const void* y)
+{
+	const block_stat_t* p = *(const block_stat_t* const*) x;
+	const block_stat_t* q = *(const block_stat_t* const*) y;
+	if ( p->misses != q->misses ) {
+		return p->misses < q->misses ? 1 : -1;
+	}
+	if ( p->evictions != q->evictions ) {
+		return p->evictions < q->evictions ? 1 : -1;
+	}
+	return p->block < q->block ? -1 : p->block > q->block;
+}
 
-/* The cache we are simulating */
-cache_t cache;  
+/* compareConflicts - qsort order for the most-conflicted-sets report */
+int compareConflicts(const void* x, const void* y)
+{
+	const set_stat_t* p = &set_stats[*(const int*) x];
+	const set_stat_t* q = &set_stats[*(const int*) y];
+	if ( p->conflicts != q->conflicts ) {
+		return p->conflicts < q->conflicts ? 1 : -1;
+	}
+	if ( p->misses != q->misses ) {
+		return p->misses < q->misses ? 1 : -1;
+	}
+	return *(const int*) x - *(const int*) y;
+}
 
-/* TODO - COMPLETE THIS FUNCTION
- * initCache - 
- * Allocate data structures to hold info regrading the sets and cache lines
- * use struct "cache_line_t" here
- * Initialize valid and tag field with 0s.
- * use S (= 2^s) and E while allocating the data structures here
+/* printAnalysis - print the miss classification, the hottest lines and the
+ * most conflicted sets
  */
-void initCache()
+void printAnalysis()
 {
-	// set big S and big B using little s and little b
-	S = pow( 2, s ); 
-	B = pow( 2, b );
+	printf( "compulsory:%llu capacity:%llu conflict:%llu\n",
+		compulsory_count, capacity_count, conflict_count );
+
+	block_stat_t** hot = malloc( sizeof( block_stat_t* ) * ( blocks.used + 1 ) );
+	size_t count = 0;
+	for ( size_t i = 0; i < blocks.cap; i++ ) {
+		if ( blocks.slots[i].used && blocks.slots[i].misses > 0 ) {
+			hot[count++] = &blocks.slots[i];
+		}
+	}
+	qsort( hot, count, sizeof( block_stat_t* ), compareMisses );
+	printf( "hottest lines:\n" );
+	for ( size_t i = 0; i < count && i < (size_t) top_n; i++ ) {
+		printf( "  line 0x%llx: set:%llu misses:%llu evictions:%llu accesses:%llu\n",
+			hot[i]->block << b,
+			(unsigned long long) modelIndex( index_mode, hot[i]->block, S ), hot[i]->misses,
+			hot[i]->evictions, hot[i]->accesses );
+	}
+	free( hot );
+
+	int* sets = malloc( sizeof( int ) * S );
+	for ( int i = 0; i < S; i++ ) {
+		sets[i] = i;
+	}
+	qsort( sets, S, sizeof( int ), compareConflicts );
+	printf( "most conflicted sets:\n" );
+	for ( int i = 0; i < S && i < top_n && set_stats[sets[i]].misses > 0; i++ ) {
+		set_stat_t* st = &set_stats[sets[i]];
+		printf( "  set %d: conflict:%llu misses:%llu evictions:%llu\n",
+			sets[i], st->conflicts, st->misses, st->evictions );
+	}
+	free( sets );
+}
 
-	// allocate the cache with memory for the correct number of cache sets 
-	cache = malloc( sizeof( cache_set_t ) * S ) ;
+/* replayCores - interleave the per-core traces and replay them against the
+ * coherent per-core caches, round-robin or by timestamp
+ */
+void replayCores()
+{
+	trace_reader_t trace[MAX_CORES];
+	trace_rec_t next[MAX_CORES];
+	int live[MAX_CORES];
+	int remaining = 0;
+
+	for ( int c = 0; c < num_cores; c++ ) {
+		openTrace( &trace[c], core_traces[c], interleave_ts );
+		live[c] = readRecord( &trace[c], &next[c] );
+		remaining += live[c];
+	}
 
-	// loop through each set and malloc the correct number of cache lines 
-	for( int i = 0; i < S; i++ ) {
-		cache[i] = malloc( sizeof( cache_line_t ) * E ); 
+	int turn = 0;
+	while ( remaining > 0 ) {
+		// pick the core that issues the next access
+		int core = -1;
+		if ( interleave_ts ) {
+			for ( int c = 0; c < num_cores; c++ ) {
+				if ( live[c] && ( core < 0 || next[c].ts < next[core].ts ) ) {
+					core = c;
+				}
+			}
+		} else {
+			while ( !live[turn] ) {
+				turn = ( turn + 1 ) % num_cores;
+			}
+			core = turn;
+			turn = ( turn + 1 ) % num_cores;
+		}
 
-		// set the values of each field of each line in the set to 0 to start 
-		for ( int k = 0; k < E; k++ ) {
-			cache[i][k].valid = 0; 
-			cache[i][k].tag = 0; 
-			cache[i][k].counter = 0;
+		trace_rec_t* rec = &next[core];
+		if ( verbosity ) {
+			printf( "core %d: %c %llx,%u\n", core, rec->op, rec->addr, rec->len );
+		}
+		if ( rec->op == 'M' ) {
+			coherentAccess( core, 'L', rec->addr, rec->len );
+			coherentAccess( core, 'S', rec->addr, rec->len );
+		} else {
+			coherentAccess( core, rec->op, rec->addr, rec->len );
 		}
+
+		live[core] = readRecord( &trace[core], rec );
+		remaining -= !live[core];
+	}
+
+	for ( int c = 0; c < num_cores; c++ ) {
+		closeTrace( &trace[c] );
 	}
 }
 
+/* Type: One point of the sweep grid and its results */
+typedef struct sweep_job {
+    int s;
+    int E;
+    int b;
+    int policy;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+} sweep_job_t;
 
-/* TODO - COMPLETE THIS FUNCTION 
- * freeCache - free each piece of memory you allocated using malloc 
- * inside initCache() function
+/* Sweep state: the decoded trace is shared read-only by every worker, which
+ * claim jobs by atomically bumping sweep_next
  */
-void freeCache()
-{	
-	// free up allocated memory in cache in reverse order that it was allocated 
-	for ( int i = 0; i < S; i++ ) {
-		free( cache[i] ); 
+mem_addr_t* sweep_addrs;
+size_t sweep_len = 0;
+sweep_job_t* sweep_jobs;
+size_t sweep_count = 0;
+size_t sweep_next = 0;
+
+/* loadTrace - decode every data access of trace_fn into sweep_addrs, with
+ * modify records expanded into their load and store
+ */
+void loadTrace(char* trace_fn)
+{
+	size_t cap = 1 << 16;
+	trace_rec_t rec;
+	trace_reader_t trace;
+
+	openTrace( &trace, trace_fn, 0 );
+	sweep_addrs = malloc( sizeof( mem_addr_t ) * cap );
+	while ( sweep_addrs != NULL && readRecord( &trace, &rec ) ) {
+		if ( sweep_len + 2 > cap ) {
+			cap *= 2;
+			sweep_addrs = realloc( sweep_addrs, sizeof( mem_addr_t ) * cap );
+			if ( sweep_addrs == NULL ) {
+				break;
+			}
+		}
+		if ( rec.op == 'M' ) {
+			sweep_addrs[sweep_len++] = rec.addr;
+		}
+		sweep_addrs[sweep_len++] = rec.addr;
 	}
-	free( cache );
+	if ( sweep_addrs == NULL ) {
+		fprintf( stderr, "Cannot allocate trace buffer\n" );
+		exit( 1 );
+	}
+	closeTrace( &trace );
 }
 
-/* TODO - COMPLETE THIS FUNCTION 
- * accessData - Access data at memory address addr.
- *   If it is already in cache, increase hit_count
- *   If it is not in cache, bring it in cache, increase miss count.
- *   Also increase eviction_count if a line is evicted.
- *   you will manipulate data structures allocated in initCache() here
- */
-void accessData(mem_addr_t addr)
-{ 
-	// calculate the number of t bits 
-	int shiftAmount = s + b;
-	int t = 64 - ( s + b );
-	
-	// isolate the set bits in the address 
-	unsigned long long setBits = ( ( addr << t ) >> ( t + b ) );	
+/* elapsed - seconds from start to end */
+double elapsed(struct timespec* start, struct timespec* end)
+{
+	return ( end->tv_sec - start->tv_sec ) + ( end->tv_nsec - start->tv_nsec ) / 1e9;
+}
 
-	// isolate the tag bits in the address 
-	unsigned long long tagBits = addr >> shiftAmount;
+/* replayMeasured - replayTrace in two timed phases: decode the whole trace
+ * into memory, then simulate it, reporting both times on stderr
+ */
+void replayMeasured(char* trace_fn)
+{
+	struct timespec t0, t1, t2;
 
-	// boolean and int to keep track if the address is found in the cache
-	bool found = false;
-	int lineFound = -1;
+	clock_gettime( CLOCK_MONOTONIC, &t0 );
+	loadTrace( trace_fn );
+	clock_gettime( CLOCK_MONOTONIC, &t1 );
+	for ( size_t i = 0; i < sweep_len; i++ ) {
+		simulateAccess( sweep_addrs[i] );
+	}
+	clock_gettime( CLOCK_MONOTONIC, &t2 );
 
-	// boolean to keep track if all cache lines are set or not   
-	bool allValid = true;
+	double parse = elapsed( &t0, &t1 );
+	double simulate = elapsed( &t1, &t2 );
+	fprintf( stderr, "accesses:%zu parse:%.6fs simulate:%.6fs rate:%.0f/s kernel:%s\n",
+		sweep_len, parse, simulate, simulate > 0 ? sweep_len / simulate : 0.0,
+		kernel_name );
+	free( sweep_addrs );
+}
 
-	// used to keep track of the max counter seen in the cache set 
-	int max = -1;
+/* runSweepJob - simulate the whole decoded trace on the cache of one job.
+ * Uses only job-local state so any number of jobs can run at once.
+ */
+void runSweepJob(sweep_job_t* job)
+{
+	size_t sets = (size_t) 1 << job->s;
+	int shift = job->s + job->b;
+	packed_cache_t c;
+	unsigned long long clock = 0;
+	unsigned long long rng = RNG_SEED;
+	mem_addr_t evicted;
 
-	// stores free line found in cache set
-	int freeLine = -1;
+	allocPacked( &c, sets, job->E );
+	for ( size_t i = 0; i < sweep_len; i++ ) {
+		mem_addr_t addr = sweep_addrs[i];
+		size_t set = ( addr >> job->b ) & ( sets - 1 );
+		mem_addr_t tagBits = shift < 64 ? addr >> shift : 0;
 
-	for ( int i = 0; i < E; i++ ) {
-	
-		// take the current line of the set corresponding to the address' set bits
-		cache_line_t currLine = cache[setBits][i];
+		evicted = INVALID_TAG;
+		if ( packedAccess( &c, set, tagBits, job->policy, &clock, &rng, &evicted ) ) {
+			job->hits++;
+		} else {
+			job->misses++;
+			job->evictions += evicted != INVALID_TAG;
+		}
+	}
+	freePacked( &c );
+}
 
-		// if an open line is found then save it and set allValid to false 
-		if ( currLine.valid == 0 ) {
-			allValid = false;
-			freeLine = i;
+/* sweepWorker - thread body: run jobs until none are left */
+void* sweepWorker(void* arg)
+{
+	(void) arg;
+	for ( ;; ) {
+		size_t i = __atomic_fetch_add( &sweep_next, 1, __ATOMIC_RELAXED );
+		if ( i >= sweep_count ) {
+			return NULL;
 		}
+		runSweepJob( &sweep_jobs[i] );
+	}
+}
 
-		// if line is valid and tag matches, set found to true and save the line 
-		if ( currLine.tag == tagBits && currLine.valid == 1 && found == false ) {
-			found = true;
-			lineFound = i;
-		} 	
+/* parseIntList - parse "1,2,4" or ranges like "1-8" into out, returns the
+ * number of values or 0 on a malformed list
+ */
+int parseIntList(char* list, int* out, int max)
+{
+	int n = 0;
+	for ( char* tok = strtok( list, "," ); tok != NULL; tok = strtok( NULL, "," ) ) {
+		int lo, hi;
+		int fields = sscanf( tok, "%d-%d", &lo, &hi );
+		if ( fields < 1 || lo < 0 ) {
+			return 0;
+		}
+		if ( fields == 1 ) {
+			hi = lo;
+		}
+		for ( int v = lo; v <= hi; v++ ) {
+			if ( n == max ) {
+				return 0;
+			}
+			out[n++] = v;
+		}
+	}
+	return n;
+}
 
-		// continuously update max to find the max counter value among the valid lines
-		if ( currLine.valid == 1 && currLine.counter > max ) {
-			max = currLine.counter;
+/* parsePolicy - return the policy named name, or -1 */
+int parsePolicy(const char* name)
+{
+	for ( int i = 0; i < NUM_POLICIES; i++ ) {
+		if ( strcmp( name, policy_names[i] ) == 0 ) {
+			return i;
 		}
+	}
+	return -1;
+}
+
+/* compareJobCost - qsort order putting the most expensive jobs first so the
+ * pool does not end on one long straggler
+ */
+int compareJobCost(const void* x, const void* y)
+{
+	const sweep_job_t* p = x;
+	const sweep_job_t* q = y;
+	return q->E - p->E;
+}
 
+/* compareJobGrid - qsort order of the result table */
+int compareJobGrid(const void* x, const void* y)
+{
+	const sweep_job_t* p = x;
+	const sweep_job_t* q = y;
+	if ( p->s != q->s ) {
+		return p->s - q->s;
+	}
+	if ( p->E != q->E ) {
+		return p->E - q->E;
 	}
+	if ( p->b != q->b ) {
+		return p->b - q->b;
+	}
+	return p->policy - q->policy;
+}
 
-	// if address was found, update the hit counter and that lines counter 
-	if ( found ) {
-		hit_count++;
-		cache[setBits][lineFound].counter = max + 1;
+/* runSweep - build the grid from the -s/-E/-b/-r lists, simulate every point
+ * on a thread pool and write the result table
+ */
+void runSweep(char* argv[])
+{
+	int sv[MAX_GRID], Ev[MAX_GRID], bv[MAX_GRID], rv[NUM_POLICIES];
+	int ns = s_list ? parseIntList( s_list, sv, MAX_GRID ) : 0;
+	int nE = E_list ? parseIntList( E_list, Ev, MAX_GRID ) : 0;
+	int nb = b_list ? parseIntList( b_list, bv, MAX_GRID ) : 0;
+	int nr = 0;
+
+	if ( r_list == NULL ) {
+		rv[nr++] = POLICY_LRU;
+	} else {
+		for ( char* tok = strtok( r_list, "," ); tok != NULL; tok = strtok( NULL, "," ) ) {
+			int pol = parsePolicy( tok );
+			if ( pol < 0 || nr == NUM_POLICIES ) {
+				nr = 0;
+				break;
+			}
+			rv[nr++] = pol;
+		}
+	}
+	if ( ns == 0 || nE == 0 || nb == 0 || nr == 0 ) {
+		printf( "%s: Bad or missing sweep lists\n", argv[0] );
+		printUsage( argv, 1 );
 	}
 
-	// if address was not found, update miss counter and see if eviction is necessary 
-	if ( !found ) {
-		miss_count++;
-		if ( allValid ) { 
-			eviction_count++;
-		
-			// keep track of the least recently used position 
-        		int min = cache[setBits][0].counter;
-        		int leastRecUsedLine = 0;			
-
-			// loop through lines to find least recently used line 
-			for ( int j = 1; j < E; j++ ) {
-				if ( cache[setBits][j].counter < min ) {
-					leastRecUsedLine = j;
-					min = cache[setBits][j].counter;
+	sweep_jobs = calloc( (size_t) ns * nE * nb * nr, sizeof( sweep_job_t ) );
+	for ( int i = 0; i < ns; i++ ) {
+		for ( int j = 0; j < nE; j++ ) {
+			for ( int k = 0; k < nb; k++ ) {
+				for ( int r = 0; r < nr; r++ ) {
+					if ( sv[i] + bv[k] > 63 || Ev[j] == 0 ) {
+						continue;
+					}
+					sweep_job_t* job = &sweep_jobs[sweep_count++];
+					job->s = sv[i];
+					job->E = Ev[j];
+					job->b = bv[k];
+					job->policy = rv[r];
 				}
 			}
+		}
+	}
 
-			// evict the line that was least recently used
-			cache[setBits][leastRecUsedLine].valid = 1;
-			cache[setBits][leastRecUsedLine].counter = max + 1;
-			cache[setBits][leastRecUsedLine].tag = tagBits;	
-		} else {
-			// place address in a free line 
-			cache[setBits][freeLine].valid = 1;
-			cache[setBits][freeLine].counter = max + 1; 
-			cache[setBits][freeLine].tag = tagBits; 
+	loadTrace( trace_file );
+	qsort( sweep_jobs, sweep_count, sizeof( sweep_job_t ), compareJobCost );
+
+	int threads = sweep_threads;
+	if ( threads <= 0 ) {
+		threads = sysconf( _SC_NPROCESSORS_ONLN );
+	}
+	if ( threads > (int) sweep_count ) {
+		threads = sweep_count;
+	}
+	pthread_t* pool = malloc( sizeof( pthread_t ) * ( threads + 1 ) );
+	for ( int i = 0; i < threads; i++ ) {
+		if ( pthread_create( &pool[i], NULL, sweepWorker, NULL ) != 0 ) {
+			fprintf( stderr, "Cannot create worker thread\n" );
+			exit( 1 );
 		}
 	}
+	for ( int i = 0; i < threads; i++ ) {
+		pthread_join( pool[i], NULL );
+	}
+	free( pool );
 
+	FILE* out = stdout;
+	if ( window_file != NULL ) {
+		out = fopen( window_file, "w" );
+		if ( !out ) {
+			fprintf( stderr, "%s: %s\n", window_file, strerror( errno ) );
+			exit( 1 );
+		}
+	}
+	qsort( sweep_jobs, sweep_count, sizeof( sweep_job_t ), compareJobGrid );
+	fprintf( out, "s,E,b,policy,size_bytes,accesses,hits,misses,evictions,miss_rate\n" );
+	for ( size_t i = 0; i < sweep_count; i++ ) {
+		sweep_job_t* job = &sweep_jobs[i];
+		fprintf( out, "%d,%d,%d,%s,%llu,%zu,%llu,%llu,%llu,%.6f\n", job->s, job->E,
+			job->b, policy_names[job->policy],
+			( 1ULL << ( job->s + job->b ) ) * job->E, sweep_len, job->hits,
+			job->misses, job->evictions,
+			sweep_len ? (double) job->misses / sweep_len : 0.0 );
+	}
+	if ( out != stdout ) {
+		fclose( out );
+	}
+	free( sweep_jobs );
+	free( sweep_addrs );
 }
 
-/* TODO - FILL IN THE MISSING CODE
- * replayTrace - replays the given trace file against the cache 
- * reads the input trace file line by line
- * extracts the type of each memory access : L/S/M
- * YOU MUST TRANSLATE one "L" as a load i.e. 1 memory access
- * YOU MUST TRANSLATE one "S" as a store i.e. 1 memory access
- * YOU MUST TRANSLATE one "M" as a load followed by a store i.e. 2 memory accesses 
+/* parsePageSizes - parse a comma separated list of page sizes (4k, 2m, 1g)
+ * into tlb_page_bits, returns 0 on a malformed list
  */
-void replayTrace(char* trace_fn)
+int parsePageSizes(char* list)
 {
-    char buf[1000];
-    mem_addr_t addr=0;
-    unsigned int len=0;
-    FILE* trace_fp = fopen(trace_fn, "r");
-
-    if(!trace_fp){
-        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
-        exit(1);
-    }
-
-    while( fgets(buf, 1000, trace_fp) != NULL) {
-        if(buf[1]=='S' || buf[1]=='L' || buf[1]=='M') {
-            sscanf(buf+3, "%llx,%u", &addr, &len);
-      
-            if(verbosity)
-                printf("%c %llx,%u ", buf[1], addr, len);
-
-           // TODO - MISSING CODE
-           // now you have: 
-           // 1. address accessed in variable - addr 
-           // 2. type of acccess(S/L/M)  in variable - buf[1] 
-           // call accessData function here depending on type of access
-	    
-	    // set the misses, hits and evictions 
-//	    int miss = miss_count;
-//	    int hit = hit_count;
-//	    int eviction = eviction_count;
-
-	    // if modify instruction, call accessData twice 
-	    if ( buf[1] == 'M' ) {
-	    	accessData( addr );
-	    }	
-	    accessData( addr );
-	    
-	    // print appropriate result based on how the misses, hits and evictions change 	
-//	    if ( miss < miss_count ) {
-//	    	printf( "Miss" );
-//	    }	
-//	    if ( hit < hit_count ) {
-//		printf( "Hit" );
-//	    }
-//	    if ( eviction < eviction_count ) {
-//	    	printf( "Eviction" );
-//	    }
-		
-            if (verbosity)
-                printf("\n");
-        }
-    }
+	tlb_count = 0;
+	for ( char* tok = strtok( list, "," ); tok != NULL; tok = strtok( NULL, "," ) ) {
+		int bits;
+		if ( strcasecmp( tok, "4k" ) == 0 ) {
+			bits = 12;
+		} else if ( strcasecmp( tok, "2m" ) == 0 ) {
+			bits = 21;
+		} else if ( strcasecmp( tok, "1g" ) == 0 ) {
+			bits = 30;
+		} else {
+			return 0;
+		}
+		if ( tlb_count == MAX_TLBS ) {
+			return 0;
+		}
+		tlb_page_bits[tlb_count++] = bits;
+	}
+	return tlb_count > 0;
+}
 
-    fclose(trace_fp);
+/* parseTlbGeometry - parse "entries:ways[,entries:ways]" for the L1 and
+ * optional L2 TLB, returns 0 on a malformed or inconsistent geometry
+ */
+int parseTlbGeometry(char* spec)
+{
+	tlb_levels = 0;
+	for ( char* tok = strtok( spec, "," ); tok != NULL; tok = strtok( NULL, "," ) ) {
+		int entries, ways;
+		if ( tlb_levels == 2 || sscanf( tok, "%d:%d", &entries, &ways ) != 2 ||
+				entries <= 0 || ways <= 0 || entries % ways != 0 ) {
+			return 0;
+		}
+		tlb_entries[tlb_levels] = entries;
+		tlb_ways[tlb_levels] = ways;
+		tlb_levels++;
+	}
+	return tlb_levels > 0;
 }
 
 /*
- * printUsage - Print usage info
+ * printUsage - Print usage info and exit with status
  */
-void printUsage(char* argv[])
+void printUsage(char* argv[], int status)
 {
-    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file> [-t <file> ...]\n", argv[0]);
+    printf("          [-H plain|xor|skew] [-S <num>] [-V <num>] [-C <file> [-c <num>]] [-l <file>]\n");
+    printf("          [-a] [-d] [-F <frac>] [-w <num> [-j] [-o <file>]] [-p <sizes> [-T <geometry>]]\n");
+    printf("          [-m] [-K scalar|sse4.2|avx2] [-r lru|fifo|random] [-P mesi|moesi] [-i rr|ts] [-n <num>]\n");
+    printf("       %s -G -s <list> -E <list> -b <list> [-r <list>] [-J <num>] -t <file>\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
     printf("  -s <num>   Number of set index bits.\n");
     printf("  -E <num>   Number of lines per set.\n");
     printf("  -b <num>   Number of block offset bits.\n");
-    printf("  -t <file>  Trace file.\n");
+    printf("  -t <file>  Trace file, repeat once per core for multi-core mode.\n");
+    printf("  -r <name>  Replacement policy: lru (default), fifo or random.\n");
+    printf("  -G         Sweep every combination of the -s/-E/-b/-r lists.\n");
+    printf("  -J <num>   Sweep worker threads (default one per CPU).\n");
+    printf("  -K <name>  Tag lookup kernel: scalar, sse4.2 or avx2 (default best).\n");
+    printf("  -m         Time the parse and simulate phases (on stderr).\n");
+    printf("  -H <name>  Set index function: plain (default), xor or skew.\n");
+    printf("  -S <num>   Number of sets, need not be a power of 2 (replaces -s).\n");
+    printf("  -V <num>   Add a fully associative victim cache of <num> lines.\n");
+    printf("  -C <file>  Save the cache state to <file> at the end of the run,\n");
+    printf("  -c <num>   ... or after <num> accesses.\n");
+    printf("  -l <file>  Start from the cache state saved in <file>.\n");
+    printf("  -F <frac>  Simulate only this fraction of the sets and scale up.\n");
+    printf("  -d         Print the reuse-distance histogram.\n");
+    printf("  -a         Classify misses (3C) and report hot lines and sets.\n");
+    printf("  -w <num>   Write statistics for every <num> accesses (CSV).\n");
+    printf("  -j         Write the window statistics as JSON instead.\n");
+    printf("  -o <file>  Window statistics or sweep table file (default stdout).\n");
+    printf("  -p <list>  Also simulate TLBs for these page sizes, e.g. 4k,2m,1g.\n");
+    printf("  -T <geom>  TLB entries:ways per level (default 64:4,1536:12).\n");
+    printf("  -P <name>  Coherence protocol of the per-core caches (default mesi).\n");
+    printf("  -i <name>  Interleave core traces round-robin (rr, default) or by\n");
+    printf("             leading timestamp (ts).\n");
+    printf("  -n <num>   Number of lines listed in hot-line reports (default 10).\n");
     printf("\nExamples:\n");
     printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
     printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
-    exit(0);
+    printf("  linux>  %s -a -n 5 -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -w 100000 -j -o yi.json -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -p 4k,2m -T 64:4,1024:8 -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -s 0 -E 1024 -b 6 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -S 96 -E 2 -b 6 -H xor -V 8 -t traces/trans.trace\n", argv[0]);
+    printf("  linux>  %s -s 8 -E 4 -b 6 -C warm.ckpt -t warmup.trace\n", argv[0]);
+    printf("  linux>  %s -s 8 -E 4 -b 6 -l warm.ckpt -t segment.trace\n", argv[0]);
+    printf("  linux>  %s -G -s 0-8 -E 1,2,4,8 -b 4-6 -r lru,fifo -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -s 6 -E 8 -b 6 -P moesi -t core0.trace -t core1.trace\n", argv[0]);
+    exit(status);
 }
 
 /*
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded.
  */
-void printSummary(int hits, int misses, int evictions)
+void printSummary(unsigned long long hits, unsigned long long misses,
+                  unsigned long long evictions)
 {
-    printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
+    printf("hits:%llu misses:%llu evictions:%llu\n", hits, misses, evictions);
     FILE* output_fp = fopen(".csim_results", "w");
     assert(output_fp);
-    fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
+    fprintf(output_fp, "%llu %llu %llu\n", hits, misses, evictions);
     fclose(output_fp);
 }
 
 /*
- * main - Main routine 
+ * main - Main routine
  */
 int main(int argc, char* argv[])
 {
     char c;
-    
-    // Parse the command line arguments: -h, -v, -s, -E, -b, -t 
-    while( (c=getopt(argc,argv,"s:E:b:t:vh")) != -1){
+
+    // Parse the command line arguments: -h, -v, -s, -E, -b, -t, -a, -w, -j, -o, -p, -T, -P, -i, -n, -r, -G, -J, -K, -m, -d, -F, -C, -c, -l, -H, -S, -V
+    while( (c=getopt(argc,argv,"s:E:b:t:vhaw:jo:p:T:P:i:n:r:GJ:K:mdF:C:c:l:H:S:V:")) != -1){
         switch(c){
         case 's':
             s = atoi(optarg);
+            s_list = optarg;
             break;
         case 'E':
             E = atoi(optarg);
+            E_list = optarg;
             break;
         case 'b':
             b = atoi(optarg);
+            b_list = optarg;
+            break;
+        case 'r':
+            r_list = optarg;
+            break;
+        case 'G':
+            sweep = 1;
+            break;
+        case 'K':
+            kernel_name = optarg;
+            break;
+        case 'm':
+            measure = 1;
+            break;
+        case 'd':
+            reuse = 1;
+            break;
+        case 'H':
+            index_mode = -1;
+            for (int i = 0; i < NUM_INDEXES; i++) {
+                if (strcmp(optarg, index_names[i]) == 0) {
+                    index_mode = i;
+                }
+            }
+            if (index_mode < 0) {
+                printf("%s: Unknown index function %s\n", argv[0], optarg);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'S':
+            sets_override = atoi(optarg);
+            if (sets_override <= 0) {
+                printf("%s: Number of sets must be positive\n", argv[0]);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'V':
+            victim_entries = atoi(optarg);
+            if (victim_entries < 0) {
+                printf("%s: Number of victim lines must not be negative\n", argv[0]);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'C':
+            checkpoint_file = optarg;
+            break;
+        case 'c':
+            checkpoint_at = strtoull(optarg, NULL, 10);
+            break;
+        case 'l':
+            restore_file = optarg;
+            break;
+        case 'F':
+            sample_fraction = atof(optarg);
+            if (sample_fraction <= 0 || sample_fraction > 1) {
+                printf("%s: Sampling fraction must be in (0, 1]\n", argv[0]);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'J':
+            sweep_threads = atoi(optarg);
             break;
         case 't':
+            if (num_cores == MAX_CORES) {
+                printf("%s: At most %d trace files\n", argv[0], MAX_CORES);
+                exit(1);
+            }
             trace_file = optarg;
+            core_traces[num_cores++] = optarg;
             break;
         case 'v':
             verbosity = 1;
             break;
+        case 'a':
+            analyze = 1;
+            break;
+        case 'w':
+            window_size = strtoull(optarg, NULL, 10);
+            break;
+        case 'j':
+            window_json = 1;
+            break;
+        case 'o':
+            window_file = optarg;
+            break;
+        case 'p':
+            if (!parsePageSizes(optarg)) {
+                printf("%s: Bad page size list %s\n", argv[0], optarg);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'T':
+            if (!parseTlbGeometry(optarg)) {
+                printf("%s: Bad TLB geometry %s\n", argv[0], optarg);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'P':
+            coherence = 1;
+            if (strcmp(optarg, "moesi") == 0) {
+                moesi = 1;
+            } else if (strcmp(optarg, "mesi") != 0) {
+                printf("%s: Unknown protocol %s\n", argv[0], optarg);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'i':
+            if (strcmp(optarg, "ts") == 0) {
+                interleave_ts = 1;
+            } else if (strcmp(optarg, "rr") != 0) {
+                printf("%s: Unknown interleaving %s\n", argv[0], optarg);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'n':
+            top_n = atoi(optarg);
+            break;
         case 'h':
-            printUsage(argv);
-            exit(0);
+            printUsage(argv, 0);
+            break;
         default:
-            printUsage(argv);
-            exit(1);
+            printUsage(argv, 1);
+        }
+    }
+
+    if (!selectKernels()) {
+        printf("%s: Lookup kernel %s is not available\n", argv[0], kernel_name);
+        printUsage(argv, 1);
+    }
+
+    /* Sweep mode takes lists and runs a grid of caches instead of one */
+    if (sweep) {
+        if (trace_file == NULL) {
+            printf("%s: Missing required command line argument\n", argv[0]);
+            printUsage(argv, 1);
         }
+        runSweep(argv);
+        return 0;
+    }
+
+    /* A single replacement policy outside of sweep mode */
+    if (r_list != NULL && (policy = parsePolicy(r_list)) < 0) {
+        printf("%s: Unknown replacement policy %s\n", argv[0], r_list);
+        printUsage(argv, 1);
     }
 
     /* Make sure that all required command line args were specified */
-    if (s == 0 || E == 0 || b == 0 || trace_file == NULL) {
+    /* s may be 0 for a fully associative cache, so check it was given */
+    if ((s_list == NULL && sets_override == 0) || E == 0 || b == 0 || trace_file == NULL) {
         printf("%s: Missing required command line argument\n", argv[0]);
-        printUsage(argv);
-        exit(1);
+        printUsage(argv, 1);
+    }
+
+    /* The cache and its victim cache must have sizes the models can allocate */
+    if (E < 0) {
+        printf("%s: Number of lines per set must be positive\n", argv[0]);
+        printUsage(argv, 1);
+    }
+    if (sets_override == 0 && (s < 0 || s > 30)) {
+        printf("%s: Number of set index bits must be between 0 and 30\n", argv[0]);
+        printUsage(argv, 1);
+    }
+    long long lines = (sets_override ? sets_override : 1LL << s) * E;
+    if (lines > INT_MAX) {
+        printf("%s: Cache of %lld lines is too large\n", argv[0], lines);
+        printUsage(argv, 1);
+    }
+    if (victim_entries > lines) {
+        printf("%s: Victim cache of %d lines is larger than the cache\n", argv[0], victim_entries);
+        printUsage(argv, 1);
+    }
+
+    /* Several traces mean several cores */
+    if (num_cores > 1) {
+        coherence = 1;
     }
 
     /* Initialize cache */
     initCache();
- 
-    replayTrace(trace_file);
+
+    if (coherence) {
+        for (int i = 0; i < num_cores; i++) {
+            core_cache[i] = allocCache();
+        }
+        replayCores();
+        printCoherence();
+        for (int i = 0; i < num_cores; i++) {
+            releaseCache(core_cache[i]);
+            hit_count += core_stats[i].hits;
+            miss_count += core_stats[i].misses;
+            eviction_count += core_stats[i].evictions;
+        }
+        freeBlocks(&blocks);
+    } else {
+        if (analyze || compare_count) {
+            initAnalysis();
+        }
+        if (restore_file != NULL) {
+            restoreCheckpoint();
+        }
+        if (sample_fraction) {
+            initSampling();
+        }
+        if (window_size) {
+            openWindows();
+        }
+        if (tlb_count) {
+            initTlbs();
+        }
+        if (measure) {
+            replayMeasured(trace_file);
+        } else {
+            replayTrace(trace_file);
+        }
+        if (window_size) {
+            closeWindows();
+        }
+        /* Save before the analysis state is freed and sampling scales the counters */
+        if (checkpoint_file != NULL && checkpoint_at == 0) {
+            saveCheckpoint();
+        } else if (checkpoint_file != NULL && access_count < checkpoint_at) {
+            fprintf(stderr, "%s: Trace ended after %llu accesses, no checkpoint saved at %llu\n",
+                argv[0], access_count, checkpoint_at);
+        }
+        if (tlb_count) {
+            printTlbs();
+            freeTlbs();
+        }
+        if (reuse) {
+            printReuse();
+        }
+        if (compare_count) {
+            printComparison();
+        }
+        if (analyze) {
+            printAnalysis();
+        }
+        if (analyze || compare_count) {
+            freeAnalysis();
+        }
+        if (sample_fraction) {
+            finishSampling();
+        }
+        freeBlocks(&blocks);
+    }
 
     /* Free allocated memory */
     freeCache();
@@ -363,6 +2894,4 @@ int main(int argc, char* argv[])
     /* Output the hit and miss statistics for the autograder */
     printSummary(hit_count, miss_count, eviction_count);
     return 0;
-} 
-
-
+}
@@ -0,0 +1,26 @@
+/*
+ * trace.h - Binary trace format shared by csim and tracegen
+ *
+ * A binary trace is the 8 byte magic TRACE_MAGIC followed by fixed-size
+ * records in host (little-endian) byte order.  Each record is one data
+ * access, with the same meaning as a " L addr,len" Valgrind line; csim tells
+ * the two formats apart by the magic.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "CSIMTRC1"
+#define TRACE_MAGIC_LEN 8
+
+/* Type: One binary trace record (16 bytes) */
+typedef struct trace_bin_rec {
+    uint64_t addr;
+    uint32_t len;
+    char op; /* 'L', 'S' or 'M' */
+    char pad[3];
+} trace_bin_rec_t;
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ * tracegen.c - Generate memory traces for csim from parameterized access
+ *     patterns, without running a program under an instrumentation tool.
+ *
+ * Each kernel emits the data accesses a simple loop over an array would
+ * make, as Valgrind-format lines (" S 601040,4") or as the binary records of
+ * trace.h.  The defaults reproduce the p4/Part 1 programs:
+ *
+ *   cache1D.c       tracegen -k linear -n 100000
+ *   cache2Drows.c   tracegen -k rows -r 3000 -c 500
+ *   cache2Dcols.c   tracegen -k cols -r 3000 -c 500
+ *
+ * Only the array accesses are generated; loop counters are assumed to live
+ * in registers.
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "trace.h"
+
+typedef unsigned long long int mem_addr_t;
+
+/* Access pattern kernels */
+typedef enum {
+    KERNEL_LINEAR = 0,
+    KERNEL_ROWS,
+    KERNEL_COLS,
+    KERNEL_STRIDE,
+    KERNEL_TILED,
+    KERNEL_RANDOM,
+    KERNEL_CHASE,
+    NUM_KERNELS
+} kernel_t;
+
+const char* kernel_names[NUM_KERNELS] = {
+    "linear", "rows", "cols", "stride", "tiled", "random", "chase"
+};
+
+/* Globals set by command line args */
+int kernel = KERNEL_LINEAR;
+unsigned long long elements = 100000; /* 1D kernels: array length */
+unsigned long long rows = 3000; /* 2D kernels: array dimensions */
+unsigned long long cols = 500;
+unsigned int elem_size = 4; /* bytes per element */
+mem_addr_t base = 0x601040; /* address of element 0 */
+unsigned long long stride = 16; /* elements between accesses (stride) */
+unsigned long long tile = 32; /* tile edge in elements (tiled) */
+unsigned long long count = 0; /* accesses (random, chase), 0 = elements */
+unsigned long long seed = 1; /* random, chase */
+unsigned long long passes = 1; /* times the whole pattern is repeated */
+char op = 0; /* access type, 0 = kernel default */
+int binary = 0; /* write binary records instead of text */
+char* out_file = NULL; /* output file, stdout if not given */
+
+/* Output stream */
+FILE* out;
+
+/* emit - write one access of elem_size bytes at addr */
+static inline void emit(mem_addr_t addr)
+{
+	if ( binary ) {
+		trace_bin_rec_t rec = { addr, elem_size, op, { 0, 0, 0 } };
+		fwrite( &rec, sizeof( rec ), 1, out );
+	} else {
+		fprintf( out, " %c %llx,%u\n", op, addr, elem_size );
+	}
+}
+
+/* nextRandom - xorshift64 step of the generator in *state */
+static inline unsigned long long nextRandom(unsigned long long* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+/* generateTiled - row-major walk over tile x tile blocks of the 2D array */
+void generateTiled()
+{
+	for ( unsigned long long ti = 0; ti < rows; ti += tile ) {
+		for ( unsigned long long tj = 0; tj < cols; tj += tile ) {
+			for ( unsigned long long i = ti; i < ti + tile && i < rows; i++ ) {
+				for ( unsigned long long j = tj; j < tj + tile && j < cols; j++ ) {
+					emit( base + ( i * cols + j ) * elem_size );
+				}
+			}
+		}
+	}
+}
+
+/* generateChase - follow a random single-cycle permutation of the elements,
+ * as a linked list shuffled through the array would (Sattolo's algorithm)
+ */
+void generateChase(unsigned long long* state)
+{
+	unsigned long long* next = malloc( sizeof( unsigned long long ) * elements );
+	if ( next == NULL ) {
+		fprintf( stderr, "Cannot allocate permutation\n" );
+		exit( 1 );
+	}
+	for ( unsigned long long i = 0; i < elements; i++ ) {
+		next[i] = i;
+	}
+	for ( unsigned long long i = elements - 1; i > 0; i-- ) {
+		unsigned long long j = nextRandom( state ) % i;
+		unsigned long long tmp = next[i];
+		next[i] = next[j];
+		next[j] = tmp;
+	}
+	unsigned long long at = 0;
+	for ( unsigned long long i = 0; i < count; i++ ) {
+		emit( base + at * elem_size );
+		at = next[at];
+	}
+	free( next );
+}
+
+/* generate - emit one pass of the selected kernel */
+void generate(unsigned long long* state)
+{
+	switch ( kernel ) {
+	case KERNEL_LINEAR:
+		for ( unsigned long long i = 0; i < elements; i++ ) {
+			emit( base + i * elem_size );
+		}
+		break;
+	case KERNEL_ROWS:
+		for ( unsigned long long i = 0; i < rows; i++ ) {
+			for ( unsigned long long j = 0; j < cols; j++ ) {
+				emit( base + ( i * cols + j ) * elem_size );
+			}
+		}
+		break;
+	case KERNEL_COLS:
+		for ( unsigned long long j = 0; j < cols; j++ ) {
+			for ( unsigned long long i = 0; i < rows; i++ ) {
+				emit( base + ( i * cols + j ) * elem_size );
+			}
+		}
+		break;
+	case KERNEL_STRIDE:
+		for ( unsigned long long i = 0; i < elements; i += stride ) {
+			emit( base + i * elem_size );
+		}
+		break;
+	case KERNEL_TILED:
+		generateTiled();
+		break;
+	case KERNEL_RANDOM:
+		for ( unsigned long long i = 0; i < count; i++ ) {
+			emit( base + nextRandom( state ) % elements * elem_size );
+		}
+		break;
+	case KERNEL_CHASE:
+		generateChase( state );
+		break;
+	}
+}
+
+/*
+ * printUsage - Print usage info and exit with status; the help goes to
+ * stderr on errors, as stdout may be the trace
+ */
+void printUsage(char* argv[], int status)
+{
+    FILE* fp = status ? stderr : stdout;
+    fprintf(fp, "Usage: %s [-hB] [-k <kernel>] [-n <num>] [-r <num>] [-c <num>] [-e <bytes>]\n", argv[0]);
+    fprintf(fp, "          [-a <hex>] [-x <num>] [-T <num>] [-N <num>] [-S <num>]\n");
+    fprintf(fp, "          [-p <num>] [-O L|S|M] [-o <file>]\n");
+    fprintf(fp, "Options:\n");
+    fprintf(fp, "  -h         Print this help message.\n");
+    fprintf(fp, "  -k <name>  Kernel: linear, rows, cols, stride, tiled, random, chase.\n");
+    fprintf(fp, "  -n <num>   Elements of the 1D array (linear, stride, random, chase).\n");
+    fprintf(fp, "  -r <num>   Rows of the 2D array (rows, cols, tiled).\n");
+    fprintf(fp, "  -c <num>   Columns of the 2D array (rows, cols, tiled).\n");
+    fprintf(fp, "  -e <bytes> Element size (default 4).\n");
+    fprintf(fp, "  -a <hex>   Address of the first element (default 601040).\n");
+    fprintf(fp, "  -x <num>   Stride in elements (stride, default 16).\n");
+    fprintf(fp, "  -T <num>   Tile edge in elements (tiled, default 32).\n");
+    fprintf(fp, "  -N <num>   Accesses (random, chase; default one per element).\n");
+    fprintf(fp, "  -S <num>   Random seed (random, chase).\n");
+    fprintf(fp, "  -p <num>   Number of passes over the pattern.\n");
+    fprintf(fp, "  -O <op>    Access type (default S, L for chase).\n");
+    fprintf(fp, "  -B         Write the binary trace format instead of text.\n");
+    fprintf(fp, "  -o <file>  Output file (default stdout).\n");
+    fprintf(fp, "\nExamples:\n");
+    fprintf(fp, "  linux>  %s -k cols -r 3000 -c 500 -o cols.trace\n", argv[0]);
+    fprintf(fp, "  linux>  %s -B -k chase -n 1048576 -e 64 -o chase.bin\n", argv[0]);
+    exit(status);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[])
+{
+    char c;
+
+    while( (c=getopt(argc,argv,"hk:n:r:c:e:a:x:T:N:S:p:O:Bo:")) != -1){
+        switch(c){
+        case 'k':
+            kernel = -1;
+            for (int i = 0; i < NUM_KERNELS; i++) {
+                if (strcmp(optarg, kernel_names[i]) == 0) {
+                    kernel = i;
+                }
+            }
+            if (kernel < 0) {
+                fprintf(stderr, "%s: Unknown kernel %s\n", argv[0], optarg);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'n':
+            elements = strtoull(optarg, NULL, 10);
+            break;
+        case 'r':
+            rows = strtoull(optarg, NULL, 10);
+            break;
+        case 'c':
+            cols = strtoull(optarg, NULL, 10);
+            break;
+        case 'e':
+            elem_size = atoi(optarg);
+            break;
+        case 'a':
+            base = strtoull(optarg, NULL, 16);
+            break;
+        case 'x':
+            stride = strtoull(optarg, NULL, 10);
+            break;
+        case 'T':
+            tile = strtoull(optarg, NULL, 10);
+            break;
+        case 'N':
+            count = strtoull(optarg, NULL, 10);
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'p':
+            passes = strtoull(optarg, NULL, 10);
+            break;
+        case 'O':
+            op = optarg[0];
+            if ((op != 'L' && op != 'S' && op != 'M') || optarg[1] != '\0') {
+                fprintf(stderr, "%s: Access type must be L, S or M\n", argv[0]);
+                printUsage(argv, 1);
+            }
+            break;
+        case 'B':
+            binary = 1;
+            break;
+        case 'o':
+            out_file = optarg;
+            break;
+        case 'h':
+            printUsage(argv, 0);
+            break;
+        default:
+            printUsage(argv, 1);
+        }
+    }
+
+    if (elements == 0 || rows == 0 || cols == 0 || elem_size == 0 ||
+            stride == 0 || tile == 0) {
+        fprintf(stderr, "%s: Sizes, stride and tile must be positive\n", argv[0]);
+        exit(1);
+    }
+    if (count == 0) {
+        count = elements;
+    }
+    if (op == 0) {
+        op = kernel == KERNEL_CHASE ? 'L' : 'S';
+    }
+    if (seed == 0) {
+        seed = 1;
+    }
+
+    out = stdout;
+    if (out_file != NULL) {
+        out = fopen(out_file, "w");
+        if (!out) {
+            fprintf(stderr, "%s: %s\n", out_file, strerror(errno));
+            exit(1);
+        }
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    if (binary) {
+        fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, out);
+    }
+
+    unsigned long long state = seed;
+    for (unsigned long long p = 0; p < passes; p++) {
+        generate(&state);
+    }
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "%s: %s\n", out_file ? out_file : "stdout", strerror(errno));
+        exit(1);
+    }
+    return 0;
+}